@@ -35,6 +35,7 @@
 
 #include "ui.h"
 #include "processor.h"
+#include "tables.h"
 
 using namespace batumi;
 using namespace stmlib;
@@ -45,6 +46,19 @@ Adc adc;
 Ui ui;
 Processor processor;
 
+#ifdef PROFILE_ISR
+// Cycles left in the TIM1 tick in the worst case so far, per feature
+// mode; read them with the debugger.
+volatile int32_t isr_headroom[FEAT_MODE_LAST];
+// Earliest and latest DAC write in the tick, in cycles from its start;
+// the new values drive the PWM comparators from then on
+volatile uint32_t isr_write_offset[2];
+// Ticks, and cycles spent in them, with the processor running [0] and
+// idle [1]; the core waits in WFI for the rest of each period
+volatile uint32_t isr_ticks[2];
+volatile uint64_t isr_cycles[2];
+#endif
+
 extern "C" {
   void HardFault_Handler(void) { while (1); }
   void MemManage_Handler(void) { while (1); }
@@ -59,12 +73,26 @@ extern "C" {
 }
 
 void Init() {
-  sys.Init(F_CPU / SAMPLE_RATE - 1, true);
+  sys.Init(kTimerPeriod - 1, true);
   system_clock.Init();
   adc.Init();
   ui.Init(&adc); // must be after adc
   dac.Init();
-  processor.Init(&ui, &adc, &dac);
+  processor.Init(kTimerRate);
+
+#ifdef PROFILE_ISR
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+  for (uint8_t i=0; i<FEAT_MODE_LAST; i++)
+    isr_headroom[i] = kTimerPeriod;
+  isr_write_offset[0] = UINT32_MAX;
+  isr_write_offset[1] = 0;
+  for (uint8_t i=0; i<2; i++) {
+    isr_ticks[i] = 0;
+    isr_cycles[i] = 0;
+  }
+#endif
 
   sys.StartTimers();
 }
@@ -87,14 +115,54 @@ extern "C" {
 
   // fast timer for processing
   void TIM1_UP_IRQHandler(void) {
+#ifdef PROFILE_ISR
+    uint32_t start = DWT->CYCCNT;
+#endif
     if (TIM_GetITStatus(TIM1, TIM_IT_Update) == RESET) {
       return;
     }
     TIM_ClearITPendingBit(TIM1, TIM_IT_Update);
 
-    adc.Scan();
-    processor.Process();
+    // output the frame computed on the previous tick first, at a fixed
+    // offset from the timer edge whatever the processing time
     dac.Write();
+#ifdef PROFILE_ISR
+    uint32_t offset = DWT->CYCCNT - start;
+    if (offset < isr_write_offset[0])
+      isr_write_offset[0] = offset;
+    if (offset > isr_write_offset[1])
+      isr_write_offset[1] = offset;
+#endif
+
+    adc.Scan();
+
+    // do not run during the splash animation
+    if (ui.mode() != UI_MODE_SPLASH) {
+      ProcessorInput input;
+      ProcessorOutput output;
+      for (uint8_t i=0; i<kNumChannels; i++) {
+        input.cv[i] = adc.cv(i);
+        input.reset[i] = adc.reset(i);
+      }
+      // the CVs are on the first mux positions
+      uint8_t read = adc.last_read();
+      input.cv_updated = read < kNumChannels ? 1 << read : 0;
+      processor.Process(ui.parameters(), &input, &output, 1);
+      for (uint8_t i=0; i<kNumChannels; i++) {
+        dac.set_sine(i, output.sine[i]);
+        dac.set_asgn(i, output.asgn[i]);
+      }
+    }
+
+#ifdef PROFILE_ISR
+    uint32_t cycles = DWT->CYCCNT - start;
+    int32_t headroom = kTimerPeriod - cycles;
+    FeatureMode mode = ui.feat_mode();
+    if (headroom < isr_headroom[mode])
+      isr_headroom[mode] = headroom;
+    isr_ticks[processor.idle()]++;
+    isr_cycles[processor.idle()] += cycles;
+#endif
   }
   
 }
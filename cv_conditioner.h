@@ -0,0 +1,99 @@
+// Copyright 2015 Matthias Puech
+//
+// Author: Matthias Puech (matthias.puech@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// CV conditioning: 2-pole smoothing, slew limiting and dead-band
+// hysteresis, run once per update of the CV.
+
+#ifndef BATUMI_CV_CONDITIONER_H_
+#define BATUMI_CV_CONDITIONER_H_
+
+#include "stmlib/stmlib.h"
+
+namespace batumi {
+
+class CvConditioner {
+ public:
+  CvConditioner() { }
+  ~CvConditioner() { }
+
+  void Init();
+
+  // two cascaded one-pole filters of coefficient 1/2^shift; 0 bypasses
+  // the smoothing
+  inline void set_filter_shift(uint8_t shift) {
+    filter_shift_ = shift;
+  }
+
+  // largest change of the output per update; 0 for no limit
+  inline void set_slew(uint16_t slew) {
+    slew_ = slew;
+  }
+
+  // changes of the filtered CV up to this from the output hold it
+  inline void set_hysteresis(uint16_t hysteresis) {
+    hysteresis_ = hysteresis;
+  }
+
+  inline int16_t Process(int16_t cv) {
+    // states have 8 fractional bits, or small steps would never settle
+    int32_t x = static_cast<int32_t>(cv) << 8;
+    if (filter_shift_) {
+      int32_t round = 1 << (filter_shift_ - 1);
+      state_[0] += (x - state_[0] + round) >> filter_shift_;
+      state_[1] += (state_[0] - state_[1] + round) >> filter_shift_;
+      x = state_[1];
+    }
+    int32_t y = (x + 128) >> 8;
+
+    // inside the band the output holds; out of it, it follows the input
+    if (y <= value_ + hysteresis_ && y >= value_ - hysteresis_) {
+      return value_;
+    }
+
+    if (slew_) {
+      CONSTRAIN(y, value_ - slew_, value_ + slew_);
+    }
+    value_ = y;
+    return value_;
+  }
+
+  inline int16_t value() const {
+    return value_;
+  }
+
+ private:
+  int32_t state_[2];
+  int16_t value_;
+  uint16_t slew_;
+  uint16_t hysteresis_;
+  uint8_t filter_shift_;
+
+  DISALLOW_COPY_AND_ASSIGN(CvConditioner);
+};
+
+}  // namespace batumi
+
+#endif  // BATUMI_CV_CONDITIONER_H_
@@ -36,6 +36,8 @@ void Adc::Init() {
   
   RCC_APB2PeriphClockCmd(RCC_APB2Periph_ADC1, ENABLE);
   RCC_APB2PeriphClockCmd(RCC_APB2Periph_ADC2, ENABLE);
+  // the reset value (PCLK2 / 2, 36MHz) is out of spec
+  RCC_ADCCLKConfig(RCC_PCLK2_Div6);
 
   ADC_InitTypeDef adc_init;
   GPIO_InitTypeDef gpio_init;
@@ -53,17 +55,41 @@ void Adc::Init() {
 
   ADC_DeInit(ADC1);
   ADC_DeInit(ADC2);
-  adc_init.ADC_Mode = ADC_Mode_Independent;
-  adc_init.ADC_ScanConvMode = DISABLE;
+  // both ADCs convert simultaneously a burst of kAdcOversampling
+  // samples, ADC2 being triggered by ADC1
+  adc_init.ADC_Mode = ADC_Mode_RegSimult;
+  adc_init.ADC_ScanConvMode = ENABLE;
   adc_init.ADC_ContinuousConvMode = DISABLE;
   adc_init.ADC_ExternalTrigConv = ADC_ExternalTrigConv_None;
   adc_init.ADC_DataAlign = ADC_DataAlign_Left;
-  adc_init.ADC_NbrOfChannel = 1;
+  adc_init.ADC_NbrOfChannel = kAdcOversampling;
   ADC_Init(ADC1, &adc_init);
   ADC_Init(ADC2, &adc_init);
 
-  ADC_RegularChannelConfig(ADC1, ADC_Channel_1, 1, ADC_SampleTime_55Cycles5);
-  ADC_RegularChannelConfig(ADC2, ADC_Channel_0, 1, ADC_SampleTime_55Cycles5);
+  for (uint8_t i=1; i<=kAdcOversampling; i++) {
+    ADC_RegularChannelConfig(ADC1, ADC_Channel_1, i, ADC_SampleTime_55Cycles5);
+    ADC_RegularChannelConfig(ADC2, ADC_Channel_0, i, ADC_SampleTime_55Cycles5);
+  }
+  ADC_ExternalTrigConvCmd(ADC2, ENABLE);
+
+  // the data register of ADC1 holds both results in dual mode; one
+  // burst fills the buffer exactly, so circular mode needs no re-arming
+  DMA_InitTypeDef dma_init;
+  DMA_DeInit(DMA1_Channel1);
+  dma_init.DMA_PeripheralBaseAddr = reinterpret_cast<uint32_t>(&ADC1->DR);
+  dma_init.DMA_MemoryBaseAddr = reinterpret_cast<uint32_t>(samples_);
+  dma_init.DMA_DIR = DMA_DIR_PeripheralSRC;
+  dma_init.DMA_BufferSize = kAdcOversampling;
+  dma_init.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+  dma_init.DMA_MemoryInc = DMA_MemoryInc_Enable;
+  dma_init.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Word;
+  dma_init.DMA_MemoryDataSize = DMA_MemoryDataSize_Word;
+  dma_init.DMA_Mode = DMA_Mode_Circular;
+  dma_init.DMA_Priority = DMA_Priority_High;
+  dma_init.DMA_M2M = DMA_M2M_Disable;
+  DMA_Init(DMA1_Channel1, &dma_init);
+  DMA_Cmd(DMA1_Channel1, ENABLE);
+  ADC_DMACmd(ADC1, ENABLE);
 
   ADC_Cmd(ADC1, ENABLE);
   ADC_Cmd(ADC2, ENABLE);
@@ -91,9 +117,16 @@ void Adc::Init() {
 
 void Adc::Scan() {
   if (state_) {
-    // Read the value from the previous conversion.
-    values1_[index_] = ADC1->DR - 32768;
-    values2_[index_] = ADC2->DR - 32768;
+    // Average the burst of conversions started on the previous tick;
+    // the extra bits land below the 12 bits of each conversion.
+    uint32_t sum1 = 0;
+    uint32_t sum2 = 0;
+    for (uint8_t i=0; i<kAdcOversampling; i++) {
+      sum1 += samples_[i] & 0xffff;
+      sum2 += samples_[i] >> 16;
+    }
+    values1_[index_] = sum1 / kAdcOversampling - 32768;
+    values2_[index_] = sum2 / kAdcOversampling - 32768;
     last_read_ = index_;
     ++index_;
     if (index_ >= kNumAdcChannels) {
@@ -107,7 +140,6 @@ void Adc::Scan() {
   
   } else {
     ADC_SoftwareStartConvCmd(ADC1, ENABLE);
-    ADC_SoftwareStartConvCmd(ADC2, ENABLE);
   }
   state_ = !state_;
 }
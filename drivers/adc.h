@@ -34,6 +34,18 @@
 namespace batumi {
 
 const uint8_t kNumAdcChannels = 8;
+// ADC clock, PCLK2 / 6: 12MHz, within the 14MHz limit
+const uint32_t kAdcClock = F_CPU / 6;
+// 55.5 cycles of sampling (ADC_SampleTime_55Cycles5) and 12.5 of
+// conversion
+const uint32_t kAdcConversionCycles = 68;
+// conversions averaged on each visit of a mux position: the burst is
+// started on one tick and read on the next, so it must fit in a tick
+const uint8_t kAdcOversampling =
+  kAdcClock / SAMPLE_RATE >= 8 * kAdcConversionCycles ? 8 : 4;
+
+static_assert(kAdcOversampling * kAdcConversionCycles * SAMPLE_RATE <=
+	      kAdcClock, "the ADC burst does not fit in a tick");
 
 enum AdcChannel {
   ADC_CV1,
@@ -76,10 +88,18 @@ class Adc {
     return value(ADC_POT1+i) + 32768;
   }
 
+  // mux position whose values the last Scan read, or kNumAdcChannels
+  // if it only started the conversions
+  inline uint8_t last_read() const {
+    return state_ ? kNumAdcChannels : last_read_;
+  }
 
  private:
   int16_t values1_[kNumAdcChannels];
   int16_t values2_[kNumAdcChannels];
+  // filled by DMA: ADC1 conversions in the lower half-words, ADC2 in
+  // the upper ones
+  uint32_t samples_[kAdcOversampling];
 
   bool state_;
   uint8_t index_;
@@ -52,7 +52,10 @@ void Dac::Init() {
   TIM_TimeBaseInitTypeDef timer_init;
   TIM_TimeBaseStructInit(&timer_init);
   timer_init.TIM_Period = (1 << kPwmResolution) - 1;
-  timer_init.TIM_Prescaler = 1;
+  // 8.8kHz carrier, or 17.6kHz above 16384Hz: the 12-bit PWM period
+  // (4096 timer cycles) stays longer than a tick at all the supported
+  // sample rates
+  timer_init.TIM_Prescaler = SAMPLE_RATE > 16384 ? 0 : 1;
   timer_init.TIM_ClockDivision = TIM_CKD_DIV1;
   timer_init.TIM_CounterMode = TIM_CounterMode_Up;
   timer_init.TIM_RepetitionCounter = 0;
@@ -76,6 +79,11 @@ void Dac::Init() {
   TIM_OC3Init(TIM4, &output_compare);
   TIM_OC4Init(TIM4, &output_compare);
 
+  // the compare registers are not preloaded: a new value takes effect
+  // as soon as it is written, at a fixed offset from the tick. The PWM
+  // timers run free, so the first output edge it sets still falls
+  // anywhere in the following PWM period (see tools/dac_timing.py)
+
   for (int i=0; i<kNumDacChannels; i++)
     value_[i] = UINT16_MAX;
   Write();
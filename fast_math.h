@@ -0,0 +1,91 @@
+// Copyright 2015 Matthias Puech
+//
+// Author: Matthias Puech (matthias.puech@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Fixed-point exp2, sine and tanh computed with short polynomials, for the
+// paths that cannot afford a lookup table. Error and Cortex-M3 cost are
+// given for each function; the costs are counted from the instructions
+// (UMULL/SMULL take 3 to 5 cycles, UDIV 2 to 12).
+
+#ifndef BATUMI_FAST_MATH_H_
+#define BATUMI_FAST_MATH_H_
+
+#include "stmlib/stmlib.h"
+
+namespace batumi {
+
+// 2^(x/65536) in Q31, for 0 <= x < 65536, i.e. between 2^31 and 2^32 - 1.
+// Minimax polynomial of degree 5: relative error below 3e-7, about 30
+// cycles. The caller shifts the result by the integral part of the exponent.
+inline uint32_t Exp2(uint16_t x) {
+  uint32_t t = static_cast<uint32_t>(x) << 16;
+  // 2^t = 1 + t.q(t), coefficients of q in Q32
+  uint32_t q = 7692123UL;
+  q = 39488820UL + (static_cast<uint64_t>(q) * t >> 32);
+  q = 239059112UL + (static_cast<uint64_t>(q) * t >> 32);
+  q = 1031679273UL + (static_cast<uint64_t>(q) * t >> 32);
+  q = 2977046220UL + (static_cast<uint64_t>(q) * t >> 32);
+  return 0x80000000UL + (static_cast<uint64_t>(q) * t >> 33);
+}
+
+// Same scale as the sine table (32767 * sin), from a full-range phase.
+// Odd polynomial of degree 7 on the quarter wave: error below 1 LSB,
+// about 35 cycles.
+inline int16_t Sine(uint32_t phase) {
+  uint8_t quadrant = phase >> 30;
+  uint32_t x = phase << 2;
+  if (quadrant & 1)
+    x = ~x;
+  // sin(pi/2 x) = x.g(x^2), values and coefficients of g in Q30
+  int32_t y = x >> 2;
+  int32_t u = static_cast<int64_t>(y) * y >> 30;
+  int32_t g = -4693342L;
+  g = 85363173L + (static_cast<int64_t>(g) * u >> 30);
+  g = -693557721L + (static_cast<int64_t>(g) * u >> 30);
+  g = 1686628441L + (static_cast<int64_t>(g) * u >> 30);
+  int32_t s = static_cast<int64_t>(g) * y >> 30;
+  s = (s - (s >> 15) + (1L << 14)) >> 15;
+  CONSTRAIN(s, 0, INT16_MAX);
+  return quadrant & 2 ? -s : s;
+}
+
+// 32767 * tanh(x / 32768), from tanh x = 1 - 2 / (e^2x + 1) with the
+// exponential above: error below 2 LSB, about 50 cycles. Saturates
+// from |x| = 5.545 (181704) on.
+inline int16_t Tanh(int32_t x) {
+  uint32_t a = x < 0 ? -x : x;
+  int32_t t = INT16_MAX;
+  if (a < 181704UL) {
+    // 2x.log2(e) in Q16
+    uint32_t y = (a * 11819UL) >> 11;
+    uint32_t e = Exp2(y & 0xffff) >> (16 - (y >> 16));
+    t -= 2147418112UL / (e + 32768UL);
+  }
+  return x < 0 ? -t : t;
+}
+
+}  // namespace batumi
+
+#endif  // BATUMI_FAST_MATH_H_
@@ -29,17 +29,43 @@
 
 #include "lfo.h"
 
-#include <cstdio>
-
 #include "stmlib/utils/dsp.h"
 #include "stmlib/utils/random.h"
 
 #include "resources.h"
+#include "tables.h"
 
 namespace batumi {
 
 using namespace stmlib;
 
+// length of the linearly interpolated segments on slow settings
+const uint8_t kRenderLengthShift = 6;
+// the corners and discontinuities of the shapes all fall on multiples
+// of 1/8th of a cycle; segments stay this far away from them (the
+// ramp wraps around slightly before the end of the cycle)
+const uint8_t kRenderBreakpointShift = 29;
+const uint32_t kRenderGuard = 1UL << 23;
+// phase drift (from pitch or phase changes) tolerated in a segment
+const int32_t kRenderTolerance = 1L << 16;
+// From this increment on (128Hz at 16384Hz), the shapes crossfade
+// between tables band-limited an octave apart. Table b keeps 16 >> b
+// harmonics and is alias-free up to an increment of 2^(27 + b); band b
+// starts at 2^(kBandShift + b) and fades into it from the previous
+// table, alias-free up to the end of the band.
+const uint8_t kBandShift = 25;
+
+// band of the increment, and the balance towards its table
+inline uint8_t ComputeBand(uint32_t increment, uint16_t* balance) {
+  uint8_t band = 31 - __builtin_clz(increment) - kBandShift;
+  if (band >= kNumWaveBands) {
+    *balance = UINT16_MAX;
+    return kNumWaveBands - 1;
+  }
+  *balance = increment >> (kBandShift - 16 + band);
+  return band;
+}
+
 void Lfo::Init() {
   phase_ = 0;
   divided_phase_ = 0;
@@ -49,25 +75,124 @@ void Lfo::Init() {
   cycle_counter_ = 0;
   level_ = UINT16_MAX;
   direction_ = true;
+  fm_reversed_ = false;
   hold_ = false;
+  bl_step_counter_ = 0;
+  render_left_ = 0;
+  render_shapes_ = 0;
+  render_carry_ = 0;
+}
+
+void Lfo::set_sample_rate(uint32_t sample_rate) {
+  increment_scale_ = (kIncrementsRate + sample_rate / 2) / sample_rate;
+  bl_step_length_ = WAV_BL_STEP0_SIZE * sample_rate / kReferenceSampleRate;
+  if (bl_step_length_ < 1)
+    bl_step_length_ = 1;
+  // multiples of the truncated 1Hz increment, as in the original
+  // firmware (3, 30 and 300 at 16384Hz)
+  pi_1hz_ = UINT16_MAX / sample_rate;
+  if (pi_1hz_ < 1)
+    pi_1hz_ = 1;
+  pi_10hz_ = pi_1hz_ * 10;
+  pi_100hz_ = pi_1hz_ * 100;
 }
 
 void Lfo::Step() {
+  // advance the reset step once per sample, whatever the number of
+  // shapes rendered
+  if (bl_step_counter_)
+    bl_step_counter_--;
+
+  uint32_t previous_phase = phase_;
   if (!hold_) {
-    phase_ += direction_ ? phase_increment_ : -phase_increment_;
+    phase_ += forward() ? phase_increment_ : -phase_increment_;
   }
 
-  if (phase_ < phase_increment_)
-    direction_ ? cycle_counter_++ : cycle_counter_--;
+  // count the cycles when the phase wraps around, in both directions
+  if (forward() && phase_ < previous_phase)
+    cycle_counter_++;
+  else if (!forward() && phase_ > previous_phase)
+    cycle_counter_ = (cycle_counter_ ? cycle_counter_ : divider_) - 1;
 
   divided_phase_ = phase_ / divider_ +
     UINT32_MAX / divider_ * (cycle_counter_ % divider_);
+
+  UpdateRendering();
+}
+
+void Lfo::UpdateRendering() {
+  uint32_t increment = phase_increment_ / divider_;
+  // below 1Hz, the shapes are not band-limited; above, they are all
+  // computed on every sample
+  if (increment >> 16 > pi_1hz_) {
+    render_left_ = 0;
+    render_carry_ = 0;
+    render_shapes_ = 0;
+    return;
+  }
+  uint32_t phase = this->phase();
+  // segments do not span the reset step
+  bool steady = !resetting();
+  if (hold_)
+    increment = 0;
+  bool on_track = render_left_ &&
+    steady &&
+    level_ == render_level_ &&
+    abs(static_cast<int32_t>(phase - render_phase_ - render_step_)) <=
+    kRenderTolerance;
+
+  if (on_track) {
+    for (uint8_t s=0; s<kNumLfoShapes; s++)
+      if (render_shapes_ & (1 << s))
+	render_value_[s] += render_delta_[s];
+    if (--render_left_) {
+      render_phase_ += render_step_;
+      return;
+    }
+    // the values reached at the end of a segment start the next one
+    render_carry_ = render_shapes_;
+  } else {
+    render_left_ = 0;
+    render_carry_ = 0;
+  }
+  render_shapes_ = 0;
+
+  // start a new segment, away from the breakpoints
+  if (!steady)
+    return;
+  int32_t step = forward() ? increment : -increment;
+  uint32_t end = phase + (step << kRenderLengthShift);
+  uint32_t low = forward() ? phase : end;
+  uint32_t high = forward() ? end : phase;
+  if ((low - kRenderGuard) >> kRenderBreakpointShift !=
+      (high + kRenderGuard) >> kRenderBreakpointShift) {
+    render_carry_ = 0;
+    return;
+  }
+
+  render_left_ = 1 << kRenderLengthShift;
+  render_phase_ = phase;
+  render_step_ = step;
+  render_level_ = level_;
+}
+
+void Lfo::StartRendering(LfoShape s) {
+  int32_t begin = render_carry_ & (1 << s)
+    ? render_value_[s]
+    : ComputeSampleShape(s, render_phase_) * 16384L;
+  int32_t end = ComputeSampleShape(
+      s, render_phase_ + (render_step_ << kRenderLengthShift)) * 16384L;
+  render_value_[s] = begin;
+  render_delta_[s] = (end - begin) >> kRenderLengthShift;
+  render_shapes_ |= 1 << s;
 }
 
 void Lfo::Reset(uint8_t subsample) {
   /* save the current osc. value and compute the future value at the
    * end of the reset step */
-  uint32_t end_phase = WAV_BL_STEP0_SIZE * phase_increment_ / divider_;
+  uint32_t travel = bl_step_length_ * phase_increment_ / divider_;
+  uint32_t end_phase = (forward() ? travel : -travel) +
+    phase() - divided_phase_;
   for (int i=0; i<kNumLfoShapes; i++) {
     LfoShape s = static_cast<LfoShape>(i);
     step_begin_[i] = ComputeSampleShape(s, phase());
@@ -77,8 +202,9 @@ void Lfo::Reset(uint8_t subsample) {
   // reset phase etc.
   phase_ = 0;
   cycle_counter_ = 0;
-  // and start the reset step
-  bl_step_counter_ = WAV_BL_STEP0_SIZE;
+  // and start the reset step; the next Step() brings the counter to
+  // bl_step_length_, its first sample
+  bl_step_counter_ = bl_step_length_ + 1;
   reset_subsample_ = subsample;
 }
 
@@ -96,6 +222,8 @@ uint32_t Lfo::ComputePhaseIncrement(int16_t pitch) {
   uint32_t a = lut_increments[pitch >> 4];
   uint32_t b = lut_increments[(pitch >> 4) + 1];
   uint32_t phase_increment = a + ((b - a) * (pitch & 0xf) >> 4);
+  phase_increment = static_cast<uint64_t>(phase_increment) *
+    increment_scale_ >> 16;
   return num_shifts >= 0
       ? phase_increment << num_shifts
       : phase_increment >> -num_shifts;
@@ -119,21 +247,29 @@ inline int16_t Lfo::ComputeSampleShape(LfoShape s, uint32_t phase) {
 
 int16_t Lfo::ComputeSampleShape(LfoShape s) {
   if (bl_step_counter_ == 0) {
+    if (render_left_) {
+      // shapes join a segment at its first sample only
+      if (render_left_ == 1 << kRenderLengthShift && !(render_shapes_ & (1 << s)))
+	StartRendering(s);
+      if (render_shapes_ & (1 << s))
+	return render_value_[s] >> 14;
+    }
     return ComputeSampleShape(s, phase());
   }
 
   int32_t end = step_begin_[s];
   int32_t begin = step_end_[s];
 
-  int32_t step = waveform_table[WAV_BL_STEP0 + reset_subsample_][bl_step_counter_];
+  uint16_t index = (bl_step_counter_ - 1) * WAV_BL_STEP0_SIZE /
+    bl_step_length_;
+  int32_t step = waveform_table[WAV_BL_STEP0 + reset_subsample_][index];
   step = (begin - end) * step / 30000 + end;
   CONSTRAIN(step, INT16_MIN, INT16_MAX);
-  bl_step_counter_--;
   return step;
 }
 
 int16_t Lfo::ComputeSampleSine(uint32_t phase) {
-  int16_t sine = Interpolate1022(wav_sine, phase);
+  int16_t sine = InterpolateSine1022(wav_sine.data, phase);
   return -sine * level_ >> 16;
 }
 
@@ -141,15 +277,24 @@ int16_t Lfo::ComputeSampleTriangle(uint32_t phase) {
   int16_t tri = phase < 1UL << 31
       ? -32768 + (phase >> 15)
       :  32767 - (phase >> 15);
-  uint32_t pi = phase_increment_ / divider_ >> 16;
+  uint32_t increment = phase_increment_ / divider_;
+  uint32_t pi = increment >> 16;
   int16_t x = 0;
-  if (pi > kPI100Hz) {
+  if (increment >> kBandShift) {
+    uint16_t balance;
+    uint8_t band = ComputeBand(increment, &balance);
+    int32_t a = band
+      ? Interpolate824(wav_tri_bands[band - 1].data, phase)
+      : Interpolate1022(wav_tri100, phase);
+    int32_t b = Interpolate824(wav_tri_bands[band].data, phase);
+    x = a + ((b - a) * static_cast<int32_t>(balance) >> 16);
+  } else if (pi > pi_100hz_) {
     x = Interpolate1022(wav_tri100, phase);
-  } else if (pi > kPI10Hz) {
-    uint16_t balance = (pi - kPI10Hz) * 65535L / (kPI100Hz - kPI10Hz);
+  } else if (pi > pi_10hz_) {
+    uint16_t balance = (pi - pi_10hz_) * 65535L / (pi_100hz_ - pi_10hz_);
     x = Crossfade1022(wav_tri10, wav_tri100, phase, balance);
-  } else if (pi > kPI1Hz) {
-    uint16_t balance = (pi - kPI1Hz) * 65535L / (kPI10Hz - kPI1Hz);
+  } else if (pi > pi_1hz_) {
+    uint16_t balance = (pi - pi_1hz_) * 65535L / (pi_10hz_ - pi_1hz_);
     int32_t a = tri;
     int32_t b = Interpolate1022(wav_tri10, phase);
     x = a + ((b - a) * static_cast<int32_t>(balance) >> 16);
@@ -165,15 +310,24 @@ int16_t Lfo::ComputeSampleSaw(uint32_t phase) {
 
 int16_t Lfo::ComputeSampleRamp(uint32_t phase) {
   int16_t ramp = -32678 + (phase >> 16);
-  uint32_t pi = phase_increment_ / divider_ >> 16;
+  uint32_t increment = phase_increment_ / divider_;
+  uint32_t pi = increment >> 16;
   int16_t x = 0;
-  if (pi > kPI100Hz) {
+  if (increment >> kBandShift) {
+    uint16_t balance;
+    uint8_t band = ComputeBand(increment, &balance);
+    int32_t a = band
+      ? Interpolate824(wav_ramp_bands[band - 1].data, phase)
+      : Interpolate1022(wav_saw100, phase);
+    int32_t b = Interpolate824(wav_ramp_bands[band].data, phase);
+    x = a + ((b - a) * static_cast<int32_t>(balance) >> 16);
+  } else if (pi > pi_100hz_) {
     x = Interpolate1022(wav_saw100, phase);
-  } else if (pi > kPI10Hz) {
-    uint16_t balance = (pi - kPI10Hz) * 65535L / (kPI100Hz - kPI10Hz);
+  } else if (pi > pi_10hz_) {
+    uint16_t balance = (pi - pi_10hz_) * 65535L / (pi_100hz_ - pi_10hz_);
     x = Crossfade1022(wav_saw10, wav_saw100, phase, balance);
-  } else if (pi > kPI1Hz) {
-    uint16_t balance = (pi - kPI1Hz) * 65535L / (kPI10Hz - kPI1Hz);
+  } else if (pi > pi_1hz_) {
+    uint16_t balance = (pi - pi_1hz_) * 65535L / (pi_10hz_ - pi_1hz_);
     int32_t a = ramp;
     int32_t b = Interpolate1022(wav_saw10, phase);
     x = a + ((b - a) * static_cast<int32_t>(balance) >> 16);
@@ -187,15 +341,24 @@ int16_t Lfo::ComputeSampleTrapezoid(uint32_t phase) {
   int16_t tri = phase < 1UL << 31 ? -32768 + (phase >> 15) :  32767 - (phase >> 15);
   int32_t trap = tri * 2;
   CONSTRAIN(trap, INT16_MIN, INT16_MAX);
-  uint32_t pi = phase_increment_ / divider_ >> 16;
+  uint32_t increment = phase_increment_ / divider_;
+  uint32_t pi = increment >> 16;
   int16_t x = 0;
-  if (pi > kPI100Hz) {
+  if (increment >> kBandShift) {
+    uint16_t balance;
+    uint8_t band = ComputeBand(increment, &balance);
+    int32_t a = band
+      ? Interpolate824(wav_trap_bands[band - 1].data, phase)
+      : Interpolate1022(wav_trap100, phase);
+    int32_t b = Interpolate824(wav_trap_bands[band].data, phase);
+    x = a + ((b - a) * static_cast<int32_t>(balance) >> 16);
+  } else if (pi > pi_100hz_) {
     x = Interpolate1022(wav_trap100, phase);
-  } else if (pi > kPI10Hz) {
-    uint16_t balance = (pi - kPI10Hz) * 65535L / (kPI100Hz - kPI10Hz);
+  } else if (pi > pi_10hz_) {
+    uint16_t balance = (pi - pi_10hz_) * 65535L / (pi_100hz_ - pi_10hz_);
     x = Crossfade1022(wav_trap10, wav_trap100, phase, balance);
-  } else if (pi > kPI1Hz) {
-    uint16_t balance = (pi - kPI1Hz) * 65535L / (kPI10Hz - kPI1Hz);
+  } else if (pi > pi_1hz_) {
+    uint16_t balance = (pi - pi_1hz_) * 65535L / (pi_10hz_ - pi_1hz_);
     int32_t a = trap;
     int32_t b = Interpolate1022(wav_trap10, phase);
     x = a + ((b - a) * static_cast<int32_t>(balance) >> 16);
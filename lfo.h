@@ -36,10 +36,8 @@ namespace batumi {
 
 const int16_t kOctave = 12 * 128;
 
-/* phase increment values for given frequencies */
-const uint32_t kPI1Hz = UINT16_MAX / SAMPLE_RATE * 1;
-const uint32_t kPI10Hz = UINT16_MAX / SAMPLE_RATE * 10;
-const uint32_t kPI100Hz = UINT16_MAX / SAMPLE_RATE * 100;
+// Sample rate the reset step and the CV filter are tuned for
+const uint32_t kReferenceSampleRate = 16384;
 
 enum LfoShape {
   SHAPE_SINE,
@@ -60,15 +58,32 @@ class Lfo {
   void Init();
   void Step();
 
+  // Derives the sample-rate dependent constants; the increments are
+  // computed for the timer rate (kIncrementsRate) and rescaled from there.
+  void set_sample_rate(uint32_t sample_rate);
+
   inline void set_pitch(int16_t pitch) {
     if (pitch == INT16_MIN)
       phase_increment_ = 0;
     else
       phase_increment_ = ComputePhaseIncrement(pitch);
+    fm_reversed_ = false;
   };
 
+  // through-zero linear FM: the increment of the pitch is scaled by
+  // 1 + fm / 2^16, and the LFO runs backwards below fm = -2^16
+  inline void set_pitch(int16_t pitch, int32_t fm) {
+    set_modulated_increment(ComputePhaseIncrement(pitch), fm);
+  }
+
   inline void set_period(uint32_t period) {
     phase_increment_ = UINT32_MAX / period;
+    fm_reversed_ = false;
+  }
+
+  // same FM, around the increment of a period
+  inline void set_period(uint32_t period, int32_t fm) {
+    set_modulated_increment(UINT32_MAX / period, fm);
   }
 
   inline void set_initial_phase(uint16_t phase) {
@@ -101,9 +116,24 @@ class Lfo {
 
   void Reset(uint8_t subsample);
 
+  inline bool resetting() const {
+    return bl_step_counter_ != 0;
+  }
+
+  // true when the output will not change by itself
+  inline bool is_static() const {
+    return (hold_ || phase_increment_ == 0) && !resetting();
+  }
+
+  inline uint32_t phase() const {
+    return divided_phase_ + initial_phase_ + alignment_phase_ / divider_
+      + UINT32_MAX / 1000 * 3;
+  }
+
   inline void link_to(Lfo *lfo) {
     phase_ = lfo->phase_;
     direction_ = lfo->direction_;
+    fm_reversed_ = lfo->fm_reversed_;
     alignment_phase_ = lfo->alignment_phase_;
     phase_increment_ = lfo->phase_increment_;
   }
@@ -117,28 +147,53 @@ class Lfo {
 
  private:
 
-  inline uint32_t phase() {
-    return divided_phase_ + initial_phase_ + alignment_phase_ / divider_
-      + UINT32_MAX / 1000 * 3;
-  }
-
   int16_t ComputeSampleShape(LfoShape s, uint32_t phase);
+  inline void set_modulated_increment(int64_t increment, int32_t fm) {
+    increment += increment * fm >> 16;
+    fm_reversed_ = increment < 0;
+    if (fm_reversed_)
+      increment = -increment;
+    phase_increment_ = increment < INT32_MAX ? increment : INT32_MAX;
+  }
+  // the direction set by the processor, reversed by the FM
+  inline bool forward() const {
+    return direction_ != fm_reversed_;
+  }
+  void UpdateRendering();
+  void StartRendering(LfoShape s);
 
   uint32_t ComputePhaseIncrement(int16_t pitch);
   uint32_t phase_, divided_phase_;
   uint16_t divider_, cycle_counter_;
-  uint16_t level_;
   uint32_t initial_phase_, alignment_phase_;
   uint32_t phase_increment_;
+  uint16_t level_;
   uint16_t bl_step_counter_;
+
+  /* sample-rate dependent constants */
+  uint32_t increment_scale_;
+  /* phase increment values for given frequencies */
+  uint32_t pi_1hz_, pi_10hz_, pi_100hz_;
+  uint16_t bl_step_length_;
+
+  bool direction_, fm_reversed_, hold_;
   uint8_t reset_subsample_;
-  bool direction_, hold_;
 
   /* values of the oscillators for each shape before and
    * after reset */
   int16_t step_begin_[kNumLfoShapes];
   int16_t step_end_[kNumLfoShapes];
 
+  /* adaptive-rate rendering: on slow settings, the shapes are computed
+   * every 64 samples and linearly interpolated in between (values in
+   * 18.14 fixed point) */
+  uint8_t render_left_, render_shapes_, render_carry_;
+  uint16_t render_level_;
+  uint32_t render_phase_;
+  int32_t render_step_;
+  int32_t render_value_[kNumLfoShapes];
+  int32_t render_delta_[kNumLfoShapes];
+
   DISALLOW_COPY_AND_ASSIGN(Lfo);
 };
 
@@ -26,11 +26,7 @@
 //
 // Processor. Orchestrates the four LFOs.
 
-#include "drivers/adc.h"
-#include "drivers/dac.h"
-
 #include "processor.h"
-#include "ui.h"
 #include "resources.h"
 #include "stmlib/utils/dsp.h"
 
@@ -41,24 +37,103 @@ using namespace stmlib;
 const int16_t kUnsyncPotThreshold = INT16_MAX / 20;
 const int16_t kResetThresholdLow = 10000;
 const int16_t kResetThresholdHigh = 20000;
+// CV changes smaller than this (noise) do not end the idle state
+const int16_t kIdleThreshold = 64;
+// dead band of the CV conditioning, in codes of the 16-bit scale: one
+// LSB of the 12-bit conversions, or the quantization alone would cross it
+const uint16_t kCvHysteresis = 16;
+// largest phase change of the PM per CV update (at 16384Hz), a quarter
+// of a cycle: the phase glides instead of jumping
+const uint16_t kPmSlew = 16384;
+// pitches of the VCO range (MIDI notes * 128): 20Hz to 2kHz on the
+// coarse pots, and at most 4kHz with the fine pots and the CVs
+const int16_t kVcoLowestPitch = 1982;
+const int16_t kVcoPitchSpan = 10205;
+const int16_t kVcoHighestPitch = 13723;
+// linear FM, in 1/2^16 of the increment per unit of pitch: the
+// increment grows by 3/8 per volt and crosses zero at -8/3V
+const int32_t kFmScale = 16;
 
-void Processor::Init(Ui *ui, Adc *adc, Dac *dac) {
-  ui_ = ui;
-  adc_ = adc;
-  dac_ = dac;
+void Processor::Init(uint32_t sample_rate) {
   previous_feat_mode_ = FEAT_MODE_LAST;
-  // no need to Init the LFOs, it'll be done in Process on first run
+  previous_cv_mode_ = CV_MODE_LAST;
+  // the LFOs are initialized again in Process on first run; their
+  // alignment is kept across mode changes, so it is cleared here
   for (uint8_t i=0; i<kNumChannels; i++) {
+    lfo_[i].set_sample_rate(sample_rate);
+    lfo_[i].Init();
+    lfo_[i].align();
     reset_trigger_armed_[i]= false;
+    reset_triggered_[i] = false;
+    reset_subsample_[i] = 0;
     last_reset_[i] = 0;
+    sync_period_[i] = 0;
+    // as in .bss on the module, for instances on the stack or the heap
+    previous_reset_[i] = 0;
+    last_pitch_[i] = 0;
+    synced_[i] = false;
   }
+  num_events_ = 0;
   waveform_offset_ = 0;
+  idle_ = false;
+  // the CVs are conditioned at their update rate, which follows the
+  // sample rate; keep the time constant of the filter
+  cv_filter_shift_ = 1;
+  for (uint32_t r = sample_rate; r >= 2 * kReferenceSampleRate; r >>= 1)
+    cv_filter_shift_++;
+  for (uint8_t i=0; i<kNumChannels; i++) {
+    cv_conditioner_[i].Init();
+    filtered_cv_[i] = 0;
+    interpolated_cv_[i] = 0;
+    cv_delta_[i] = 0;
+  }
+#ifdef QUADRATURE_SINE
+  quadrature_.Init();
+#endif
 }
 
-inline int16_t AdcValuesToPitch(uint16_t coarse, int16_t fine, int16_t cv) {
-  coarse = Interpolate88(lut_scale_freq, coarse) - 32768;
+// selects the conditioning stages for what the CVs drive
+void Processor::ConfigureCvConditioning(CvMode cv_mode) {
+  for (uint8_t i=0; i<kNumChannels; i++) {
+    CvConditioner* c = &cv_conditioner_[i];
+    switch (cv_mode) {
+    case CV_MODE_PITCH:
+      // smoothed, and held still by the dead band
+      c->set_filter_shift(cv_filter_shift_);
+      c->set_slew(0);
+      c->set_hysteresis(kCvHysteresis);
+      break;
+    case CV_MODE_FM:
+      // a dead band would flatten the small modulation depths
+      c->set_filter_shift(cv_filter_shift_);
+      c->set_slew(0);
+      c->set_hysteresis(0);
+      break;
+    case CV_MODE_PM:
+      // slew-limited; the CV updates are more frequent at higher rates
+      c->set_filter_shift(cv_filter_shift_);
+      c->set_slew(kPmSlew >> (cv_filter_shift_ - 1));
+      c->set_hysteresis(0);
+      break;
+    case CV_MODE_LAST: break;
+    }
+  }
+}
+
+// CV in units of pitch, 1V/oct once calibrated
+inline int16_t CvToPitch(int16_t cv, int32_t cv_scale, int16_t cv_offset) {
+  return (cv * cv_scale >> 16) + cv_offset;
+}
+
+inline int16_t AdcValuesToPitch(FrequencyRange range,
+				uint16_t coarse, int16_t fine, int16_t cv) {
   fine = (1 * kOctave * static_cast<int32_t>(fine)) >> 16;
-  cv = cv * 5 * kOctave >> 15;
+  if (range == RANGE_VCO) {
+    int32_t pitch = kVcoLowestPitch + (coarse * kVcoPitchSpan >> 16) +
+      fine + cv;
+    return pitch < kVcoHighestPitch ? pitch : kVcoHighestPitch;
+  }
+  coarse = Interpolate88(lut_scale_freq, coarse) - 32768;
   return coarse + fine + cv;
 }
 
@@ -84,160 +159,344 @@ inline uint16_t AdcValuesToLevel(uint16_t pot, int16_t fine, int16_t cv) {
   return Interpolate88(lut_scale_phase, ctrl);
 }
 
-void Processor::SetFrequency(int8_t lfo_no) {
+void Processor::SetFrequency(const ProcessorParameters& parameters,
+			     int8_t lfo_no) {
   // sync or reset
   if (reset_triggered_[lfo_no]) {
-    if (ui_->sync_mode()) {
-      lfo_[lfo_no].set_period(last_reset_[lfo_no]);
-      lfo_[lfo_no].align();
-      synced_[lfo_no] = true;
+    if (parameters.sync_mode) {
+      // outside FREE mode, channels 2-4 count no period: back in FREE
+      // mode, their first reset may come without one, which would stop
+      // the LFO (the Cortex-M3 divides by zero to 0)
+      if (last_reset_[lfo_no]) {
+	sync_period_[lfo_no] = last_reset_[lfo_no];
+	lfo_[lfo_no].set_period(last_reset_[lfo_no]);
+	lfo_[lfo_no].align();
+	synced_[lfo_no] = true;
+      }
     } else {
       lfo_[lfo_no].Reset(reset_subsample_[lfo_no]);
     }
-    reset_trigger_armed_[lfo_no] = false;
     last_reset_[lfo_no] = 0;
   } else {
     last_reset_[lfo_no]++;
   }
 
-  int16_t pitch = AdcValuesToPitch(ui_->coarse(lfo_no),
-				   ui_->fine(lfo_no),
-				   filtered_cv_[lfo_no]);
+  int16_t cv = CvToPitch(filtered_cv_[lfo_no],
+			 parameters.cv_scale[lfo_no],
+			 parameters.cv_offset[lfo_no]);
+  bool fm = parameters.cv_mode == CV_MODE_FM;
+  bool pm = parameters.cv_mode == CV_MODE_PM &&
+    parameters.feat_mode == FEAT_MODE_FREE;
+  int16_t pitch = AdcValuesToPitch(parameters.range,
+				   parameters.coarse[lfo_no],
+				   parameters.fine[lfo_no],
+				   fm || pm ? 0 : cv);
 
   // set pitch
   if (!synced_[lfo_no] ||
       (abs(pitch - last_pitch_[lfo_no]) > kUnsyncPotThreshold)) {
-    lfo_[lfo_no].set_pitch(pitch);
+    if (fm)
+      lfo_[lfo_no].set_pitch(pitch, cv * kFmScale);
+    else
+      lfo_[lfo_no].set_pitch(pitch);
     last_pitch_[lfo_no] = pitch;
     synced_[lfo_no] = false;
+  } else if (fm) {
+    lfo_[lfo_no].set_period(sync_period_[lfo_no], cv * kFmScale);
   }
 }
 
-void Processor::Process() {
+bool Processor::IsStatic(FeatureMode feat_mode, const ProcessorInput& input) {
+  for (uint8_t i=0; i<kNumChannels; i++) {
+    // the CV filter must have settled too
+    if (abs(input.cv[i] - filtered_cv_[i]) > kIdleThreshold ||
+	lfo_[i].resetting() ||
+	((feat_mode == FEAT_MODE_FREE || i == 0) && !lfo_[i].is_static()))
+      return false;
+  }
+  return true;
+}
+
+bool Processor::Wakes(const ProcessorParameters& parameters) {
+  if (parameters.feat_mode != idle_parameters_.feat_mode ||
+      parameters.range != idle_parameters_.range ||
+      parameters.cv_mode != idle_parameters_.cv_mode ||
+      parameters.shape != idle_parameters_.shape ||
+      parameters.sync_mode != idle_parameters_.sync_mode)
+    return true;
+  for (uint8_t i=0; i<kNumChannels; i++) {
+    if (parameters.coarse[i] != idle_parameters_.coarse[i] ||
+	parameters.fine[i] != idle_parameters_.fine[i] ||
+	parameters.cv_scale[i] != idle_parameters_.cv_scale[i] ||
+	parameters.cv_offset[i] != idle_parameters_.cv_offset[i] ||
+	reset_triggered_[i] != idle_reset_triggered_[i] ||
+	abs(filtered_cv_[i] - idle_cv_[i]) > kIdleThreshold)
+      return true;
+  }
+  return false;
+}
 
-  // do not run during the splash animation
-  if (ui_->mode() == UI_MODE_SPLASH)
-    return;
+void Processor::Process(const ProcessorParameters& parameters,
+			const ProcessorInput* input,
+			ProcessorOutput* output,
+			size_t size) {
 
   // reset the LFOs if mode changed
-  if (ui_->feat_mode() != previous_feat_mode_) {
+  if (parameters.feat_mode != previous_feat_mode_) {
     for (int i=0; i<kNumChannels; i++)
       lfo_[i].Init();
-    previous_feat_mode_ = ui_->feat_mode();
+    previous_feat_mode_ = parameters.feat_mode;
     waveform_offset_ = 0;
   }
 
-  for (int i=0; i<kNumChannels; i++) {
-    // filter CV
-    filtered_cv_[i] += (adc_->cv(i) - filtered_cv_[i]) >> 6;
-
-    // detect triggers on the reset input
-    int16_t reset = adc_->reset(i);
+  // outside FREE mode, the PM setting drives the pitch
+  CvMode cv_mode = parameters.cv_mode == CV_MODE_PM &&
+    parameters.feat_mode != FEAT_MODE_FREE
+    ? CV_MODE_PITCH
+    : parameters.cv_mode;
+  if (cv_mode != previous_cv_mode_) {
+    ConfigureCvConditioning(cv_mode);
+    previous_cv_mode_ = cv_mode;
+  }
 
-    if (reset < kResetThresholdLow)
-      reset_trigger_armed_[i] = true;
+  while (size) {
+    size_t block_size = size < kMaxBlockSize ? size : kMaxBlockSize;
+    ScheduleEvents(parameters.feat_mode, input, block_size);
 
-    if (reset > kResetThresholdHigh &&
-	reset_trigger_armed_[i]) {
-      reset_triggered_[i] = true;
-      int32_t dist_to_trig = kResetThresholdHigh - previous_reset_[i];
-      int32_t dist_to_next = reset - previous_reset_[i];
-      reset_subsample_[i] = dist_to_trig * 32L / dist_to_next;
-    } else {
-      reset_triggered_[i] = false;
+    // render the block in segments between the events
+    uint8_t e = 0;
+    for (size_t n = 0; n < block_size; ) {
+      for (; e < num_events_ && events_[e].offset == n; e++) {
+	uint8_t i = events_[e].channel;
+	reset_triggered_[i] = events_[e].type == EVENT_TRIGGER;
+	if (reset_triggered_[i])
+	  reset_subsample_[i] = events_[e].subsample;
+      }
+      size_t end = e < num_events_ ? events_[e].offset : block_size;
+      Render(parameters, input + n, output + n, end - n);
+      n = end;
     }
 
-    previous_reset_[i] = reset;
+    input += block_size;
+    output += block_size;
+    size -= block_size;
   }
+}
 
-  switch (ui_->feat_mode()) {
-  case FEAT_MODE_FREE:
-  {
+void Processor::ScheduleEvents(FeatureMode feat_mode,
+			       const ProcessorInput* input,
+			       size_t size) {
+  bool triggered[kNumChannels];
+  for (uint8_t i=0; i<kNumChannels; i++)
+    triggered[i] = reset_triggered_[i];
+  num_events_ = 0;
+
+  for (uint8_t n=0; n<size; n++) {
     for (uint8_t i=0; i<kNumChannels; i++) {
-      SetFrequency(i);
+      // detect triggers on the reset input
+      int16_t reset = input->reset[i];
+
+      if (reset < kResetThresholdLow)
+	reset_trigger_armed_[i] = true;
+
+      if (reset > kResetThresholdHigh &&
+	  reset_trigger_armed_[i]) {
+	// resets and waveform changes last one sample, hold and
+	// direction changes last as long as the gate
+	bool one_shot = feat_mode == FEAT_MODE_FREE || i == 0 || i == 3;
+	if (!triggered[i] || one_shot) {
+	  ResetEvent* event = &events_[num_events_++];
+	  event->offset = n;
+	  event->channel = i;
+	  event->type = EVENT_TRIGGER;
+	  int32_t dist_to_trig = kResetThresholdHigh - previous_reset_[i];
+	  int32_t dist_to_next = reset - previous_reset_[i];
+	  // a flat input would divide by zero (the Cortex-M3 returns 0)
+	  event->subsample = dist_to_next ?
+	    dist_to_trig * 32L / dist_to_next : 0;
+	  triggered[i] = true;
+	}
+	if (one_shot)
+	  reset_trigger_armed_[i] = false;
+      } else if (triggered[i]) {
+	ResetEvent* event = &events_[num_events_++];
+	event->offset = n;
+	event->channel = i;
+	event->type = EVENT_RELEASE;
+	triggered[i] = false;
+      }
+
+      previous_reset_[i] = reset;
     }
+    input++;
   }
-  break;
-
-  case FEAT_MODE_QUAD:
-  {
-    SetFrequency(0);
-    // reset 2 holds the LFOs
-    lfo_[0].set_hold(reset_triggered_[1]);
-    // reset 3 changes direction
-    lfo_[0].set_direction(!reset_triggered_[2]);
-    // reset 4 changes waveform
-    if (reset_triggered_[3]) {
-      waveform_offset_++;
-      reset_trigger_armed_[3] = false;
+}
+
+void Processor::Render(const ProcessorParameters& parameters,
+		       const ProcessorInput* input,
+		       ProcessorOutput* output,
+		       size_t size) {
+  // audio-rate pitches and phase offsets would step audibly on each
+  // update of the CVs
+  bool interpolate_cv = parameters.range == RANGE_VCO ||
+    (parameters.cv_mode == CV_MODE_PM &&
+     parameters.feat_mode == FEAT_MODE_FREE);
+
+  while (size--) {
+    // condition each CV on the sample where the ADC reads it
+    for (int i=0; i<kNumChannels; i++) {
+      if (input->cv_updated & (1 << i)) {
+	int16_t cv = cv_conditioner_[i].Process(input->cv[i]);
+	if (interpolate_cv) {
+	  interpolated_cv_[i] = filtered_cv_[i] * kCvUpdatePeriod;
+	  cv_delta_[i] = cv - filtered_cv_[i];
+	} else {
+	  filtered_cv_[i] = cv;
+	  interpolated_cv_[i] = cv * kCvUpdatePeriod;
+	  cv_delta_[i] = 0;
+	}
+      }
+      if (interpolate_cv) {
+	interpolated_cv_[i] += cv_delta_[i];
+	filtered_cv_[i] = interpolated_cv_[i] / kCvUpdatePeriod;
+      }
     }
 
-    for (int i=1; i<kNumChannels; i++) {
-      lfo_[i].link_to(&lfo_[0]);
-      lfo_[i].set_level(AdcValuesToLevel(ui_->coarse(i),
-					 ui_->fine(i),
-					 filtered_cv_[i]));
-      lfo_[i].set_initial_phase((kNumChannels - i) * (UINT16_MAX >> 2));
+    // while idle, only the inputs are tracked and the outputs hold
+    if (idle_) {
+      if (!Wakes(parameters)) {
+	for (int i=0; i<kNumChannels; i++) {
+	  if (parameters.feat_mode == FEAT_MODE_FREE || i == 0)
+	    last_reset_[i]++;
+	}
+	*output++ = idle_output_;
+	input++;
+	continue;
+      }
+      idle_ = false;
     }
-  }
-  break;
-
-  case FEAT_MODE_PHASE:
-  {
-    SetFrequency(0);
-    // reset 2 holds the LFOs
-    lfo_[0].set_hold(reset_triggered_[1]);
-    // reset 3 changes direction
-    lfo_[0].set_direction(!reset_triggered_[2]);
-    // reset 4 changes waveform
-    if (reset_triggered_[3]) {
-      waveform_offset_++;
-      reset_trigger_armed_[3] = false;
+
+    switch (parameters.feat_mode) {
+    case FEAT_MODE_FREE:
+    {
+      for (uint8_t i=0; i<kNumChannels; i++) {
+	SetFrequency(parameters, i);
+	// the CV offsets the phase, a full cycle over the ADC range
+	lfo_[i].set_initial_phase(parameters.cv_mode == CV_MODE_PM
+				  ? filtered_cv_[i] : 0);
+      }
     }
-    for (int i=1; i<kNumChannels; i++) {
-      lfo_[i].link_to(&lfo_[0]);
-      lfo_[i].set_initial_phase(AdcValuesToPhase(ui_->coarse(i),
-						 ui_->fine(i),
-						 filtered_cv_[i]));
+    break;
+
+    case FEAT_MODE_QUAD:
+    {
+      SetFrequency(parameters, 0);
+      // reset 2 holds the LFOs
+      lfo_[0].set_hold(reset_triggered_[1]);
+      // reset 3 changes direction
+      lfo_[0].set_direction(!reset_triggered_[2]);
+      // reset 4 changes waveform
+      if (reset_triggered_[3]) {
+	waveform_offset_++;
+      }
+
+      for (int i=1; i<kNumChannels; i++) {
+	lfo_[i].link_to(&lfo_[0]);
+	lfo_[i].set_level(AdcValuesToLevel(parameters.coarse[i],
+					   parameters.fine[i],
+					   filtered_cv_[i]));
+	lfo_[i].set_initial_phase((kNumChannels - i) * (UINT16_MAX >> 2));
+      }
     }
-  }
-  break;
-
-  case FEAT_MODE_DIVIDE:
-  {
-    SetFrequency(0);
-    // reset 2 holds the LFOs
-    lfo_[0].set_hold(reset_triggered_[1]);
-    // reset 3 changes direction
-    lfo_[0].set_direction(!reset_triggered_[2]);
-    // reset 4 changes waveform
-    if (reset_triggered_[3]) {
-      waveform_offset_++;
-      reset_trigger_armed_[3] = false;
+    break;
+
+    case FEAT_MODE_PHASE:
+    {
+      SetFrequency(parameters, 0);
+      // reset 2 holds the LFOs
+      lfo_[0].set_hold(reset_triggered_[1]);
+      // reset 3 changes direction
+      lfo_[0].set_direction(!reset_triggered_[2]);
+      // reset 4 changes waveform
+      if (reset_triggered_[3]) {
+	waveform_offset_++;
+      }
+      for (int i=1; i<kNumChannels; i++) {
+	lfo_[i].link_to(&lfo_[0]);
+	lfo_[i].set_initial_phase(AdcValuesToPhase(parameters.coarse[i],
+						   parameters.fine[i],
+						   filtered_cv_[i]));
+      }
     }
-    for (int i=1; i<kNumChannels; i++) {
-      lfo_[i].link_to(&lfo_[0]);
-      lfo_[i].set_divider(AdcValuesToDivider(ui_->coarse(i),
-      					     ui_->fine(i),
-      					     filtered_cv_[i]));
-      // when 1st channel resets, all other channels reset
-      if (!ui_->sync_mode() && reset_triggered_[0]) {
-	lfo_[i].Reset(reset_subsample_[0]);
+    break;
+
+    case FEAT_MODE_DIVIDE:
+    {
+      SetFrequency(parameters, 0);
+      // reset 2 holds the LFOs
+      lfo_[0].set_hold(reset_triggered_[1]);
+      // reset 3 changes direction
+      lfo_[0].set_direction(!reset_triggered_[2]);
+      // reset 4 changes waveform
+      if (reset_triggered_[3]) {
+	waveform_offset_++;
+      }
+      for (int i=1; i<kNumChannels; i++) {
+	lfo_[i].link_to(&lfo_[0]);
+	lfo_[i].set_divider(AdcValuesToDivider(parameters.coarse[i],
+					       parameters.fine[i],
+					       filtered_cv_[i]));
+	// when 1st channel resets, all other channels reset
+	if (!parameters.sync_mode && reset_triggered_[0]) {
+	  lfo_[i].Reset(reset_subsample_[0]);
+	}
       }
     }
-  }
-  break;
+    break;
 
-  case FEAT_MODE_LAST: break;	// to please the compiler
-  }
+    case FEAT_MODE_LAST: break;	// to please the compiler
+    }
 
-  // send to DAC and step
-  for (int i=0; i<kNumChannels; i++) {
-    lfo_[i].Step();
-    int s = ((ui_->shape() + waveform_offset_) % 4) + 1;
-    LfoShape shape = static_cast<LfoShape>(s);
-    dac_->set_sine(i, lfo_[i].ComputeSampleShape(SHAPE_SINE));
-    dac_->set_asgn(i, lfo_[i].ComputeSampleShape(shape));
+    // step and render
+    for (int i=0; i<kNumChannels; i++) {
+      lfo_[i].Step();
+      int s = ((parameters.shape + waveform_offset_) % 4) + 1;
+      LfoShape shape = static_cast<LfoShape>(s);
+      output->asgn[i] = lfo_[i].ComputeSampleShape(shape);
+    }
+#ifdef QUADRATURE_SINE
+    // in QUAD mode, the sines are a quarter cycle apart: one recursive
+    // oscillator renders them all, except during the reset step and
+    // on hold (the other LFOs are not held and lead by one sample)
+    if (parameters.feat_mode == FEAT_MODE_QUAD &&
+	!lfo_[0].resetting() &&
+	!reset_triggered_[1] &&
+	quadrature_.Process(lfo_[0].phase())) {
+      int32_t sine = quadrature_.sine();
+      int32_t cosine = quadrature_.cosine();
+      output->sine[0] = -sine * lfo_[0].level() >> 16;
+      output->sine[1] = cosine * lfo_[1].level() >> 16;
+      output->sine[2] = sine * lfo_[2].level() >> 16;
+      output->sine[3] = -cosine * lfo_[3].level() >> 16;
+    } else
+#endif
+    for (int i=0; i<kNumChannels; i++) {
+      output->sine[i] = lfo_[i].ComputeSampleShape(SHAPE_SINE);
+    }
+
+    if (IsStatic(parameters.feat_mode, *input)) {
+      idle_ = true;
+      idle_parameters_ = parameters;
+      for (int i=0; i<kNumChannels; i++) {
+	idle_cv_[i] = filtered_cv_[i];
+	idle_reset_triggered_[i] = reset_triggered_[i];
+      }
+      idle_output_ = *output;
+    }
+
+    input++;
+    output++;
   }
 }
-}
+
+}  // namespace batumi
@@ -29,15 +29,88 @@
 #ifndef BATUMI_MODULATIONS_PROCESSOR_H_
 #define BATUMI_MODULATIONS_PROCESSOR_H_
 
-#include "drivers/adc.h"
-#include "drivers/dac.h"
+#include "stmlib/stmlib.h"
 
+#include "cv_conditioner.h"
 #include "lfo.h"
-#include "ui.h"
+#include "quadrature_oscillator.h"
 
 namespace batumi {
 
 const uint8_t kNumChannels = 4;
+// the ADC reads each CV every this many samples
+const uint8_t kCvUpdatePeriod = 16;
+
+enum FeatureMode {
+  FEAT_MODE_FREE,
+  FEAT_MODE_QUAD,
+  FEAT_MODE_PHASE,
+  FEAT_MODE_DIVIDE,
+  FEAT_MODE_LAST
+};
+
+enum FrequencyRange {
+  RANGE_LFO,
+  // audio rate: the coarse pots span 20Hz to 2kHz
+  RANGE_VCO,
+  RANGE_LAST
+};
+
+/* what the CV inputs drive */
+enum CvMode {
+  CV_MODE_PITCH,
+  // through-zero linear FM
+  CV_MODE_FM,
+  // phase offset, in FREE mode only (pitch in the other modes)
+  CV_MODE_PM,
+  CV_MODE_LAST
+};
+
+/* state of the panel controls */
+struct ProcessorParameters {
+  FeatureMode feat_mode;
+  FrequencyRange range;
+  CvMode cv_mode;
+  uint8_t shape;
+  bool sync_mode;
+  uint16_t coarse[kNumChannels];
+  int16_t fine[kNumChannels];
+  // affine map from CV to pitch: (cv * cv_scale >> 16) + cv_offset
+  int32_t cv_scale[kNumChannels];
+  int16_t cv_offset[kNumChannels];
+};
+
+/* one sample of the CV and reset inputs */
+struct ProcessorInput {
+  int16_t cv[kNumChannels];
+  int16_t reset[kNumChannels];
+  // bit i is set on the sample where the ADC read a new value of cv[i]
+  uint8_t cv_updated;
+};
+
+enum ResetEventType {
+  EVENT_TRIGGER,
+  EVENT_RELEASE
+};
+
+/* change of state of a reset input, at a given sample of the block */
+struct ResetEvent {
+  uint8_t offset;
+  uint8_t channel;
+  uint8_t type;
+  uint8_t subsample;
+};
+
+// blocks are processed in chunks of at most this many samples
+const size_t kMaxBlockSize = 8;
+// every reset input can change on every sample
+const uint8_t kMaxEvents = kMaxBlockSize * kNumChannels;
+
+/* one sample of the sine and assignable outputs */
+struct ProcessorOutput {
+  int16_t sine[kNumChannels];
+  int16_t asgn[kNumChannels];
+};
 
 class Processor {
 public:
@@ -45,28 +118,66 @@ public:
   Processor() { }
   ~Processor() { }
 
-  void Init(Ui *ui, Adc *adc, Dac *dac);
-  void Process();
+  void Init(uint32_t sample_rate);
+  void Process(const ProcessorParameters& parameters,
+	       const ProcessorInput* input,
+	       ProcessorOutput* output,
+	       size_t size);
+
+  // true when the outputs are frozen until an input or a parameter
+  // changes; the ticks are then shorter, TIM1 keeps its rate
+  inline bool idle() const { return idle_; }
 
 private:
   Lfo lfo_[kNumChannels];
-  Ui *ui_;
-  Adc *adc_;
-  Dac *dac_;
 
   FeatureMode previous_feat_mode_;
+  CvMode previous_cv_mode_;
 
   bool reset_trigger_armed_[kNumChannels];
   bool reset_triggered_[kNumChannels];
   uint8_t reset_subsample_[kNumChannels];
   uint32_t last_reset_[kNumChannels];
+  // period the LFO is synced to, which the FM modulates
+  uint32_t sync_period_[kNumChannels];
   int16_t previous_reset_[kNumChannels];
   int16_t last_pitch_[kNumChannels];
   bool synced_[kNumChannels];
+  CvConditioner cv_conditioner_[kNumChannels];
+  uint8_t cv_filter_shift_;
   int16_t filtered_cv_[kNumChannels];
+  // in the VCO range and for phase modulation, the CVs ramp to each new
+  // value over the update period (kCvUpdatePeriod times the CV, and the
+  // change per sample)
+  int32_t interpolated_cv_[kNumChannels];
+  int16_t cv_delta_[kNumChannels];
+#ifdef QUADRATURE_SINE
+  QuadratureOscillator quadrature_;
+#endif
   uint8_t waveform_offset_;
 
-  void SetFrequency(int8_t lfo_no);
+  bool idle_;
+  ProcessorParameters idle_parameters_;
+  int16_t idle_cv_[kNumChannels];
+  bool idle_reset_triggered_[kNumChannels];
+  ProcessorOutput idle_output_;
+
+  ResetEvent events_[kMaxEvents];
+  uint8_t num_events_;
+
+  // detects the triggers in the block and queues the events
+  void ScheduleEvents(FeatureMode feat_mode,
+		      const ProcessorInput* input,
+		      size_t size);
+  // renders samples between events
+  void Render(const ProcessorParameters& parameters,
+	      const ProcessorInput* input,
+	      ProcessorOutput* output,
+	      size_t size);
+  void SetFrequency(const ProcessorParameters& parameters, int8_t lfo_no);
+  void ConfigureCvConditioning(CvMode cv_mode);
+  bool IsStatic(FeatureMode feat_mode, const ProcessorInput& input);
+  bool Wakes(const ProcessorParameters& parameters);
 
   DISALLOW_COPY_AND_ASSIGN(Processor);
 };
@@ -0,0 +1,61 @@
+// Copyright 2015 Matthias Puech
+//
+// Author: Matthias Puech (matthias.puech@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Recursive sine and cosine generator.
+
+#include "quadrature_oscillator.h"
+
+#include "tables.h"
+
+namespace batumi {
+
+void QuadratureOscillator::Init() {
+  phase_ = 0;
+  increment_ = 0;
+  resync_counter_ = 0;
+  sin_w_ = 0;
+  cos_w_ = 1L << 30;
+  Sync(0);
+}
+
+void QuadratureOscillator::Sync(uint32_t phase) {
+  sin_ = static_cast<int32_t>(InterpolateSine1022(wav_sine.data, phase)) << 15;
+  cos_ = static_cast<int32_t>(
+      InterpolateSine1022(wav_sine.data, phase + (1UL << 30))) << 15;
+  resync_counter_ = kQuadratureResyncPeriod;
+}
+
+void QuadratureOscillator::set_increment(int32_t increment) {
+  increment_ = increment;
+  // w = 2pi * increment / 2^32 in Q30, small enough for the Taylor
+  // series to be exact to the last bit in 4 terms
+  int64_t w = static_cast<int64_t>(increment) * 1686629713L >> 30;
+  int64_t w2 = w * w >> 30;
+  sin_w_ = w - (w * w2 >> 30) / 6 + (((w * w2 >> 30) * w2 >> 30) / 120);
+  cos_w_ = (1L << 30) - w2 / 2 + (w2 * w2 >> 30) / 24;
+}
+
+}  // namespace batumi
@@ -0,0 +1,108 @@
+// Copyright 2015 Matthias Puech
+//
+// Author: Matthias Puech (matthias.puech@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Recursive sine and cosine generator (coupled form), resynchronized
+// from the sine table.
+
+#ifndef BATUMI_QUADRATURE_OSCILLATOR_H_
+#define BATUMI_QUADRATURE_OSCILLATOR_H_
+
+#include "stmlib/stmlib.h"
+
+namespace batumi {
+
+// above about 120Hz, the rotation coefficients are less accurate
+const int32_t kQuadratureMaxIncrement = 1L << 25;
+// samples between two resynchronizations from the table
+const uint8_t kQuadratureResyncPeriod = 64;
+
+class QuadratureOscillator {
+ public:
+  QuadratureOscillator() { }
+  ~QuadratureOscillator() { }
+
+  void Init();
+
+  // follows the given phase: the pair is rotated when it moved by the
+  // same small increment as on the previous sample, and read from the
+  // table otherwise. Returns false when too fast to be rendered.
+  inline bool Process(uint32_t phase) {
+    int32_t increment = phase - phase_;
+    phase_ = phase;
+    if (increment > kQuadratureMaxIncrement ||
+	increment < -kQuadratureMaxIncrement) {
+      resync_counter_ = 0;
+      return false;
+    }
+    if (increment != increment_ || resync_counter_ == 0) {
+      if (increment != increment_)
+	set_increment(increment);
+      Sync(phase);
+      return true;
+    }
+    resync_counter_--;
+
+    // values in Q30
+    int32_t s = (static_cast<int64_t>(sin_) * cos_w_ +
+		 static_cast<int64_t>(cos_) * sin_w_ + (1L << 29)) >> 30;
+    int32_t c = (static_cast<int64_t>(cos_) * cos_w_ -
+		 static_cast<int64_t>(sin_) * sin_w_ + (1L << 29)) >> 30;
+    sin_ = s;
+    cos_ = c;
+    return true;
+  }
+
+  inline int16_t sine() const {
+    return ToSample(sin_);
+  }
+
+  inline int16_t cosine() const {
+    return ToSample(cos_);
+  }
+
+ private:
+  void Sync(uint32_t phase);
+  void set_increment(int32_t increment);
+
+  static inline int16_t ToSample(int32_t x) {
+    x = (x + (1L << 14)) >> 15;
+    CONSTRAIN(x, INT16_MIN, INT16_MAX);
+    return x;
+  }
+
+  int32_t sin_, cos_;
+  // rotation per sample
+  int32_t sin_w_, cos_w_;
+  uint32_t phase_;
+  int32_t increment_;
+  uint8_t resync_counter_;
+
+  DISALLOW_COPY_AND_ASSIGN(QuadratureOscillator);
+};
+
+}  // namespace batumi
+
+#endif  // BATUMI_QUADRATURE_OSCILLATOR_H_
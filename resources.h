@@ -46,15 +46,11 @@ extern const char* string_table[];
 
 extern const uint16_t* lookup_table_table[];
 
-extern const uint32_t* lookup_table_32_table[];
-
 extern const int16_t* waveform_table[];
 
 extern const uint16_t lut_scale_freq[];
 extern const uint16_t lut_scale_phase[];
 extern const uint16_t lut_scale_divide[];
-extern const uint32_t lut_increments[];
-extern const int16_t wav_sine[];
 extern const int16_t wav_saw10[];
 extern const int16_t wav_saw100[];
 extern const int16_t wav_tri10[];
@@ -100,85 +96,81 @@ extern const int16_t wav_bl_step31[];
 #define LUT_SCALE_PHASE_SIZE 257
 #define LUT_SCALE_DIVIDE 2
 #define LUT_SCALE_DIVIDE_SIZE 257
-#define LUT_INCREMENTS 0
-#define LUT_INCREMENTS_SIZE 97
-#define WAV_SINE 0
-#define WAV_SINE_SIZE 1025
-#define WAV_SAW10 1
+#define WAV_SAW10 0
 #define WAV_SAW10_SIZE 1025
-#define WAV_SAW100 2
+#define WAV_SAW100 1
 #define WAV_SAW100_SIZE 1025
-#define WAV_TRI10 3
+#define WAV_TRI10 2
 #define WAV_TRI10_SIZE 1025
-#define WAV_TRI100 4
+#define WAV_TRI100 3
 #define WAV_TRI100_SIZE 1025
-#define WAV_TRAP10 5
+#define WAV_TRAP10 4
 #define WAV_TRAP10_SIZE 1025
-#define WAV_TRAP100 6
+#define WAV_TRAP100 5
 #define WAV_TRAP100_SIZE 1025
-#define WAV_BL_STEP0 7
+#define WAV_BL_STEP0 6
 #define WAV_BL_STEP0_SIZE 8
-#define WAV_BL_STEP1 8
+#define WAV_BL_STEP1 7
 #define WAV_BL_STEP1_SIZE 8
-#define WAV_BL_STEP2 9
+#define WAV_BL_STEP2 8
 #define WAV_BL_STEP2_SIZE 8
-#define WAV_BL_STEP3 10
+#define WAV_BL_STEP3 9
 #define WAV_BL_STEP3_SIZE 8
-#define WAV_BL_STEP4 11
+#define WAV_BL_STEP4 10
 #define WAV_BL_STEP4_SIZE 8
-#define WAV_BL_STEP5 12
+#define WAV_BL_STEP5 11
 #define WAV_BL_STEP5_SIZE 8
-#define WAV_BL_STEP6 13
+#define WAV_BL_STEP6 12
 #define WAV_BL_STEP6_SIZE 8
-#define WAV_BL_STEP7 14
+#define WAV_BL_STEP7 13
 #define WAV_BL_STEP7_SIZE 8
-#define WAV_BL_STEP8 15
+#define WAV_BL_STEP8 14
 #define WAV_BL_STEP8_SIZE 8
-#define WAV_BL_STEP9 16
+#define WAV_BL_STEP9 15
 #define WAV_BL_STEP9_SIZE 8
-#define WAV_BL_STEP10 17
+#define WAV_BL_STEP10 16
 #define WAV_BL_STEP10_SIZE 8
-#define WAV_BL_STEP11 18
+#define WAV_BL_STEP11 17
 #define WAV_BL_STEP11_SIZE 8
-#define WAV_BL_STEP12 19
+#define WAV_BL_STEP12 18
 #define WAV_BL_STEP12_SIZE 8
-#define WAV_BL_STEP13 20
+#define WAV_BL_STEP13 19
 #define WAV_BL_STEP13_SIZE 8
-#define WAV_BL_STEP14 21
+#define WAV_BL_STEP14 20
 #define WAV_BL_STEP14_SIZE 8
-#define WAV_BL_STEP15 22
+#define WAV_BL_STEP15 21
 #define WAV_BL_STEP15_SIZE 8
-#define WAV_BL_STEP16 23
+#define WAV_BL_STEP16 22
 #define WAV_BL_STEP16_SIZE 8
-#define WAV_BL_STEP17 24
+#define WAV_BL_STEP17 23
 #define WAV_BL_STEP17_SIZE 8
-#define WAV_BL_STEP18 25
+#define WAV_BL_STEP18 24
 #define WAV_BL_STEP18_SIZE 8
-#define WAV_BL_STEP19 26
+#define WAV_BL_STEP19 25
 #define WAV_BL_STEP19_SIZE 8
-#define WAV_BL_STEP20 27
+#define WAV_BL_STEP20 26
 #define WAV_BL_STEP20_SIZE 8
-#define WAV_BL_STEP21 28
+#define WAV_BL_STEP21 27
 #define WAV_BL_STEP21_SIZE 8
-#define WAV_BL_STEP22 29
+#define WAV_BL_STEP22 28
 #define WAV_BL_STEP22_SIZE 8
-#define WAV_BL_STEP23 30
+#define WAV_BL_STEP23 29
 #define WAV_BL_STEP23_SIZE 8
-#define WAV_BL_STEP24 31
+#define WAV_BL_STEP24 30
 #define WAV_BL_STEP24_SIZE 8
-#define WAV_BL_STEP25 32
+#define WAV_BL_STEP25 31
 #define WAV_BL_STEP25_SIZE 8
-#define WAV_BL_STEP26 33
+#define WAV_BL_STEP26 32
 #define WAV_BL_STEP26_SIZE 8
-#define WAV_BL_STEP27 34
+#define WAV_BL_STEP27 33
 #define WAV_BL_STEP27_SIZE 8
-#define WAV_BL_STEP28 35
+#define WAV_BL_STEP28 34
 #define WAV_BL_STEP28_SIZE 8
-#define WAV_BL_STEP29 36
+#define WAV_BL_STEP29 35
 #define WAV_BL_STEP29_SIZE 8
-#define WAV_BL_STEP30 37
+#define WAV_BL_STEP30 36
 #define WAV_BL_STEP30_SIZE 8
-#define WAV_BL_STEP31 38
+#define WAV_BL_STEP31 37
 #define WAV_BL_STEP31_SIZE 8
 
 }  // namespace batumi
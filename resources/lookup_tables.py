@@ -31,27 +31,10 @@
 # Lookup table definitions.
 
 import numpy
-import os
 
-sample_rate = int(os.environ["SAMPLE_RATE"])
-
-"""----------------------------------------------------------------------------
-Pitch increments
-----------------------------------------------------------------------------"""
+# The pitch increments are computed at compile time (tables.h).
 
 lookup_tables = []
-lookup_tables_32 = []
-
-excursion = float(1 << 32)
-
-a4_midi = 69
-a4_pitch = 440.0
-notes = numpy.arange(0 * 128.0, 12 * 128.0 + 16, 16) / 128.0
-pitches = a4_pitch * 2 ** ((notes - a4_midi) / 12)
-increments = excursion / sample_rate * pitches
-
-lookup_tables_32.append(
-    ('increments', increments.astype(int)))
 
 
 """----------------------------------------------------------------------------
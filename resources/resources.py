@@ -78,8 +78,6 @@ resources = [
   ('dummy', 'string', 'STR', 'char', str, False),
   (lookup_tables.lookup_tables,
    'lookup_table', 'LUT', 'uint16_t', int, False),
-  (lookup_tables.lookup_tables_32,
-   'lookup_table_32', 'LUT', 'uint32_t', int, False),
   # (waveforms.waveforms_8,
    # 'waveform_8', 'WAV', 'uint8_t', int, True),
   (waveforms.waveforms,
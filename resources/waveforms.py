@@ -30,19 +30,9 @@
 
 import numpy
 
-WAVETABLE_SIZE = 1024
-
 waveforms = []
 
-"""----------------------------------------------------------------------------
-Sine wave
-----------------------------------------------------------------------------"""
-
-x = numpy.arange(0, WAVETABLE_SIZE + 1) / float(WAVETABLE_SIZE)
-x[-1] = x[0]
-sine = numpy.sin(2 * numpy.pi * x)
-waveforms.append(('sine', (32767 * sine).astype(int)))
-
+# The sine wave is computed at compile time (tables.h).
 
 """----------------------------------------------------------------------------
 Bandlimited waves
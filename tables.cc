@@ -0,0 +1,82 @@
+// Copyright 2015 Matthias Puech
+//
+// Author: Matthias Puech (matthias.puech@gmail.com)
+// Based on code by: Olivier Gillet (ol.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Lookup tables computed at compile time.
+
+#include "tables.h"
+
+namespace batumi {
+
+constexpr double kActualSampleRate =
+    static_cast<double>(F_CPU) / kTimerPeriod;
+
+constexpr Table<uint32_t, LUT_INCREMENTS_SIZE> lut_increments =
+    MakeIncrements<LUT_INCREMENTS_SIZE>(kActualSampleRate);
+
+#ifdef QUARTER_WAVE_TABLES
+constexpr Table<int16_t, WAV_SINE_SIZE> wav_sine =
+    MakeQuarterSine<WAV_SINE_SIZE>();
+#else
+constexpr Table<int16_t, WAV_SINE_SIZE> wav_sine = MakeSine<WAV_SINE_SIZE>();
+#endif
+
+constexpr Table<int16_t, WAV_BAND_SIZE> wav_ramp_bands[kNumWaveBands] = {
+  MakeBandLimitedRamp<WAV_BAND_SIZE>(16),
+  MakeBandLimitedRamp<WAV_BAND_SIZE>(8),
+  MakeBandLimitedRamp<WAV_BAND_SIZE>(4),
+  MakeBandLimitedRamp<WAV_BAND_SIZE>(2),
+  MakeBandLimitedRamp<WAV_BAND_SIZE>(1),
+};
+
+constexpr Table<int16_t, WAV_BAND_SIZE> wav_tri_bands[kNumWaveBands] = {
+  MakeBandLimitedTriangle<WAV_BAND_SIZE>(16, false),
+  MakeBandLimitedTriangle<WAV_BAND_SIZE>(8, false),
+  MakeBandLimitedTriangle<WAV_BAND_SIZE>(4, false),
+  MakeBandLimitedTriangle<WAV_BAND_SIZE>(2, false),
+  MakeBandLimitedTriangle<WAV_BAND_SIZE>(1, false),
+};
+
+constexpr Table<int16_t, WAV_BAND_SIZE> wav_trap_bands[kNumWaveBands] = {
+  MakeBandLimitedTriangle<WAV_BAND_SIZE>(16, true),
+  MakeBandLimitedTriangle<WAV_BAND_SIZE>(8, true),
+  MakeBandLimitedTriangle<WAV_BAND_SIZE>(4, true),
+  MakeBandLimitedTriangle<WAV_BAND_SIZE>(2, true),
+  MakeBandLimitedTriangle<WAV_BAND_SIZE>(1, true),
+};
+
+// The tables formerly generated by resources/lookup_tables.py and
+// resources/waveforms.py.
+static_assert(Checksum(MakeIncrements<LUT_INCREMENTS_SIZE>(16384)) ==
+              0x199a6084, "lut_increments");
+static_assert(Checksum(MakeSine<1025>()) == 0x673adff9, "wav_sine");
+#ifdef QUARTER_WAVE_TABLES
+static_assert(Unfolds(wav_sine, MakeSine<1025>()), "wav_sine");
+#else
+static_assert(Checksum(wav_sine) == 0x673adff9, "wav_sine");
+#endif
+
+}  // namespace batumi
@@ -0,0 +1,286 @@
+// Copyright 2015 Matthias Puech
+//
+// Author: Matthias Puech (matthias.puech@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Aliasing of the LFO shapes, measured on the host. Each shape is swept
+// from the bottom of the LFO range to the top of the VCO range, with and
+// without divider, and its spectrum compared to the ideal band-limited
+// shape: energy outside the harmonics (aliasing), and error on the
+// harmonics below Nyquist (band-limiting). Hard sync at non-integer
+// periods then resets the LFOs at every sub-sample offset.
+
+#include <cstdio>
+#include <vector>
+
+#include "lfo.h"
+#include "resources.h"
+#include "tools/harness.h"
+
+using namespace batumi;
+
+const size_t kFftSize = 65536;
+// bins on each side of a harmonic counted as the harmonic
+const int kHarmonicBins = 6;
+// below this many bins between harmonics, they cannot be told apart:
+// 4Hz at 16384Hz
+const double kMinBinSpacing = 16.0;
+// pitch of the sweep: from the lowest setting of the LFO range to the
+// highest of the VCO range, every half octave
+const int16_t kLowestPitch = 17906 - 32768;
+const int16_t kHighestPitch = 13723;
+const int16_t kPitchStep = kOctave / 2;
+const uint16_t kDividers[] = { 1, 3 };
+const uint8_t kNumDividers = 2;
+// LFO frequencies of the hard sync runs, and their ratio to the sync
+// frequency; the period of the sync is offset by the golden ratio, so
+// that the resets fall evenly on all the sub-sample offsets
+const double kSyncRatio = 2.37;
+const double kSyncFraction = 0.381966;
+const double kSyncFrequencies[] = { 110.0, 440.0, 1760.0 };
+const uint8_t kNumSyncFrequencies = 3;
+
+const char* kShapeNames[kNumLfoShapes] = {
+  "sine", "trapezoid", "ramp", "saw", "triangle"
+};
+
+// harmonic amplitudes of the naive shapes, from a DFT long enough for
+// its own aliasing to stay negligible on the harmonics measured
+class IdealShapes {
+ public:
+  IdealShapes() {
+    const size_t size = 1 << 20;
+    Lfo lfo;
+    lfo.Init();
+    lfo.set_sample_rate(SAMPLE_RATE);
+    // no band-limiting at zero frequency
+    lfo.set_pitch(INT16_MIN);
+    size_t num_harmonics = kFftSize / 2 / kMinBinSpacing + 1;
+    for (uint8_t s=0; s<kNumLfoShapes; s++) {
+      std::vector<std::complex<double> > x(size);
+      for (size_t i=0; i<size; i++)
+	x[i] = Compute(&lfo, static_cast<LfoShape>(s),
+		       static_cast<uint32_t>(i << (32 - 20)));
+      Fft(&x);
+      amplitude_[s].resize(num_harmonics);
+      for (size_t h=0; h<num_harmonics; h++)
+	amplitude_[s][h] = 2.0 * std::abs(x[h]) / size;
+    }
+  }
+
+  inline double amplitude(uint8_t shape, size_t harmonic) const {
+    return harmonic < amplitude_[shape].size()
+      ? amplitude_[shape][harmonic] : 0.0;
+  }
+
+ private:
+  static int16_t Compute(Lfo* lfo, LfoShape shape, uint32_t phase) {
+    switch (shape) {
+    case SHAPE_SINE: return lfo->ComputeSampleSine(phase);
+    case SHAPE_TRAPEZOID: return lfo->ComputeSampleTrapezoid(phase);
+    case SHAPE_RAMP: return lfo->ComputeSampleRamp(phase);
+    case SHAPE_SAW: return lfo->ComputeSampleSaw(phase);
+    case SHAPE_TRIANGLE: return lfo->ComputeSampleTriangle(phase);
+    }
+    return 0;
+  }
+
+  std::vector<double> amplitude_[kNumLfoShapes];
+};
+
+struct Measurement {
+  // energy outside the harmonics, relative to the total (dB)
+  double alias;
+  // error on the amplitude of the harmonics below Nyquist, relative to
+  // the ideal shape (dB)
+  double error;
+};
+
+inline double Decibels(double ratio) {
+  return 10.0 * log10(ratio + 1e-30);
+}
+
+// spectrum of a signal periodic every f0_bin bins
+Measurement Measure(const Spectrum& spectrum, double f0_bin,
+		    const IdealShapes& ideal, uint8_t shape) {
+  size_t last = spectrum.size() / 2;
+  std::vector<bool> harmonic(last + 1, false);
+  double error = 0.0;
+  double reference = 0.0;
+  for (size_t h=1; h * f0_bin + kHarmonicBins < last; h++) {
+    size_t center = static_cast<size_t>(h * f0_bin + 0.5);
+    double power = 0.0;
+    for (size_t i=center-kHarmonicBins; i<=center+kHarmonicBins; i++) {
+      power += spectrum.power(i);
+      harmonic[i] = true;
+    }
+    double amplitude = sqrt(4.0 * power / spectrum.window_power());
+    double difference = amplitude - ideal.amplitude(shape, h);
+    error += difference * difference;
+    reference += ideal.amplitude(shape, h) * ideal.amplitude(shape, h);
+  }
+
+  // the DC lobe is left out
+  double total = 0.0;
+  double alias = 0.0;
+  for (size_t i=kHarmonicBins+1; i<=last; i++) {
+    total += spectrum.power(i);
+    if (!harmonic[i])
+      alias += spectrum.power(i);
+  }
+  Measurement m = { Decibels(alias / total), Decibels(error / reference) };
+  return m;
+}
+
+inline double PitchToFrequency(int16_t pitch) {
+  return 440.0 * pow(2.0, (pitch / 128.0 - 69.0) / 12.0);
+}
+
+inline int16_t FrequencyToPitch(double frequency) {
+  return (69.0 + 12.0 * log2(frequency / 440.0)) * 128.0;
+}
+
+// Renders all the shapes of one LFO over the FFT size; the increment of
+// the divided phase gives the fundamental
+double Render(Lfo* lfo, std::vector<double>* shapes) {
+  uint32_t previous_phase = lfo->phase();
+  uint32_t increment = 0;
+  for (size_t i=0; i<kFftSize; i++) {
+    lfo->Step();
+    if (i == kFftSize / 2)
+      increment = lfo->phase() - previous_phase;
+    previous_phase = lfo->phase();
+    for (uint8_t s=0; s<kNumLfoShapes; s++)
+      shapes[s][i] = lfo->ComputeSampleShape(static_cast<LfoShape>(s));
+  }
+  return increment / 4294967296.0 * kFftSize;
+}
+
+void Sweep(const IdealShapes& ideal, Spectrum* spectrum) {
+  std::vector<double> shapes[kNumLfoShapes];
+  for (uint8_t s=0; s<kNumLfoShapes; s++)
+    shapes[s].resize(kFftSize);
+  Measurement worst[kNumLfoShapes];
+  for (uint8_t s=0; s<kNumLfoShapes; s++)
+    worst[s].alias = worst[s].error = -1000.0;
+
+  printf("Sweep (alias / harmonic error, dB)\n");
+  printf("%9s", "f0 (Hz)");
+  for (uint8_t s=0; s<kNumLfoShapes; s++)
+    printf(" %19s", kShapeNames[s]);
+  printf("\n");
+
+  for (int32_t pitch=kLowestPitch; pitch<=kHighestPitch;
+       pitch+=kPitchStep) {
+    for (uint8_t d=0; d<kNumDividers; d++) {
+      Lfo lfo;
+      lfo.Init();
+      lfo.set_sample_rate(SAMPLE_RATE);
+      lfo.set_pitch(pitch);
+      lfo.set_divider(kDividers[d]);
+      double f0_bin = Render(&lfo, shapes);
+      if (f0_bin < kMinBinSpacing)
+	continue;
+
+      printf("%9.2f", f0_bin * SAMPLE_RATE / kFftSize);
+      for (uint8_t s=0; s<kNumLfoShapes; s++) {
+	spectrum->Analyze(shapes[s]);
+	Measurement m = Measure(*spectrum, f0_bin, ideal, s);
+	printf(" %9.1f/%9.1f", m.alias, m.error);
+	if (m.alias > worst[s].alias)
+	  worst[s].alias = m.alias;
+	if (m.error > worst[s].error)
+	  worst[s].error = m.error;
+      }
+      printf(kDividers[d] > 1 ? " (/%d)\n" : "\n", kDividers[d]);
+    }
+  }
+  printf("%9s", "worst");
+  for (uint8_t s=0; s<kNumLfoShapes; s++)
+    printf(" %9.1f/%9.1f", worst[s].alias, worst[s].error);
+  printf("\n\n");
+}
+
+// Hard sync: the LFO resets every period samples, a non-integer number.
+// The ideal output repeats with the period, and the energy outside its
+// harmonics is the jitter of the resets on the sample grid. The
+// sub-sample offset is computed as the processor does from the crossing
+// of the threshold, or ignored.
+void Sync(const IdealShapes& ideal, Spectrum* spectrum) {
+  std::vector<double> shapes[kNumLfoShapes];
+  for (uint8_t s=0; s<kNumLfoShapes; s++)
+    shapes[s].resize(kFftSize);
+
+  printf("Hard sync, alias (dB) with / without sub-sample offset\n");
+  printf("%9s", "f0 (Hz)");
+  for (uint8_t s=0; s<kNumLfoShapes; s++)
+    printf(" %19s", kShapeNames[s]);
+  printf("\n");
+
+  for (uint8_t f=0; f<kNumSyncFrequencies; f++) {
+    double alias[2][kNumLfoShapes];
+    double period = floor(SAMPLE_RATE * kSyncRatio / kSyncFrequencies[f]) +
+      kSyncFraction;
+    for (uint8_t subsample=0; subsample<2; subsample++) {
+      Lfo lfo;
+      lfo.Init();
+      lfo.set_sample_rate(SAMPLE_RATE);
+      lfo.set_pitch(FrequencyToPitch(kSyncFrequencies[f]));
+      // starts on the first reset, and records after a period
+      double next_reset = 0.5;
+      size_t warm_up = static_cast<size_t>(period) + 1;
+      for (size_t n=0; n<warm_up+kFftSize; n++) {
+	if (n >= next_reset) {
+	  double offset = next_reset - (n - 1.0);
+	  uint8_t s = subsample ? 0 : static_cast<uint8_t>(offset * 32);
+	  lfo.Reset(s < 31 ? s : 31);
+	  next_reset += period;
+	}
+	lfo.Step();
+	for (uint8_t s=0; s<kNumLfoShapes && n>=warm_up; s++)
+	  shapes[s][n - warm_up] = lfo.ComputeSampleShape(
+	      static_cast<LfoShape>(s));
+      }
+      for (uint8_t s=0; s<kNumLfoShapes; s++) {
+	spectrum->Analyze(shapes[s]);
+	alias[subsample][s] = Measure(
+	    *spectrum, kFftSize / period, ideal, s).alias;
+      }
+    }
+    printf("%9.2f", kSyncFrequencies[f]);
+    for (uint8_t s=0; s<kNumLfoShapes; s++)
+      printf(" %9.1f/%9.1f", alias[0][s], alias[1][s]);
+    printf("\n");
+  }
+}
+
+int main() {
+  printf("Sample rate %dHz, FFT size %zu, harmonics down to %.1fHz\n\n",
+	 SAMPLE_RATE, kFftSize, kMinBinSpacing * SAMPLE_RATE / kFftSize);
+  IdealShapes ideal;
+  Spectrum spectrum(kFftSize);
+  Sweep(ideal, &spectrum);
+  Sync(ideal, &spectrum);
+  return 0;
+}
@@ -0,0 +1,252 @@
+// Copyright 2015 Matthias Puech
+//
+// Author: Matthias Puech (matthias.puech@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Noise and response of the CV acquisition, measured on the host from
+// raw 12-bit conversions of one CV input: a recording, or synthetic noise
+// when none is given. Compares the former path (one conversion per visit
+// of the mux, one-pole filter on every tick) with the current one (burst
+// of conversions averaged per visit, CvConditioner on each update).
+//
+// A recording holds consecutive conversions of one input at the rate of
+// the ADC (kAdcClock / kAdcConversionCycles), as 16-bit little-endian
+// right-aligned codes.
+
+#include <cstdio>
+
+#include "cv_conditioner.h"
+#include "drivers/adc.h"
+#include "processor.h"
+#include "tools/harness.h"
+
+using namespace batumi;
+
+// as configured by Processor::ConfigureCvConditioning
+const uint16_t kCvHysteresis = 16;
+// the former one-pole filter, at 16384Hz
+const uint8_t kFormerFilterShift = 6;
+// nominal calibration, 1V/oct: cents per 16-bit code
+const double kCentsPerCode = 2 * 5 * kOctave / 65536.0 / 128.0 * 100.0;
+// synthetic input: DC, white noise and hum, in 12-bit codes
+const double kSyntheticLevel = 2048.37;
+const double kSyntheticNoise = 1.5;
+const double kSyntheticHum = 0.5;
+const double kHumFrequency = 50.0;
+// 1V step, in 12-bit codes
+const double kStep = 4096.0 / 10.0;
+const uint32_t kNumSteps = 200;
+// ticks after a step, and within how many codes the output has settled
+const uint32_t kStepLength = 2048;
+const double kSettleTolerance = 8.0;
+
+class Input {
+ public:
+  Input() : random_(1) { }
+
+  bool Load(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (!f)
+      return false;
+    uint8_t bytes[2];
+    while (fread(bytes, 1, 2, f) == 2)
+      recording_.push_back(bytes[0] | (bytes[1] << 8));
+    fclose(f);
+    return recording_.size() > 0;
+  }
+
+  inline bool synthetic() const { return recording_.empty(); }
+
+  // conversion i, as read left-aligned by the ADC
+  int32_t Convert(uint64_t i, double offset) {
+    double code;
+    if (synthetic()) {
+      double t = i / conversion_rate();
+      code = kSyntheticLevel + kSyntheticNoise * random_.Gaussian() +
+	kSyntheticHum * sin(2 * M_PI * kHumFrequency * t);
+    } else {
+      code = recording_[i % recording_.size()];
+    }
+    code = floor(code + offset + 0.5);
+    CONSTRAIN(code, 0, 4095);
+    return static_cast<int32_t>(code) << 4;
+  }
+
+  inline size_t size() const { return recording_.size(); }
+
+  static inline double conversion_rate() {
+    return static_cast<double>(kAdcClock) / kAdcConversionCycles;
+  }
+
+ private:
+  Random random_;
+  std::vector<uint16_t> recording_;
+};
+
+enum Path {
+  PATH_FORMER,
+  PATH_PITCH,
+  PATH_FM,
+  PATH_LAST
+};
+
+const char* kPathNames[PATH_LAST] = {
+  "1x, one-pole", "burst, pitch", "burst, FM"
+};
+
+// CV seen by the processor on each tick, from the conversions of one
+// input offset by a step at a given tick
+class Acquisition {
+ public:
+  Acquisition(Path path, Input* input) : path_(path), input_(input) {
+    uint8_t shift = 1;
+    for (uint32_t r = SAMPLE_RATE; r >= 2 * kReferenceSampleRate; r >>= 1)
+      shift++;
+    former_shift_ = kFormerFilterShift + shift - 1;
+    conditioner_.Init();
+    conditioner_.set_filter_shift(shift);
+    conditioner_.set_slew(0);
+    conditioner_.set_hysteresis(path == PATH_PITCH ? kCvHysteresis : 0);
+    value_ = 0;
+    former_ = 0;
+  }
+
+  int16_t Tick(uint64_t tick, uint64_t step_tick) {
+    double offset = tick >= step_tick ? kStep : 0.0;
+    // the burst starts on the visit, and is read on the next tick
+    if (tick % kCvUpdatePeriod == 0) {
+      uint64_t first = tick * Input::conversion_rate() / SAMPLE_RATE;
+      if (path_ == PATH_FORMER) {
+	held_ = input_->Convert(first, offset) - 32768;
+      } else {
+	int32_t sum = 0;
+	for (uint8_t i=0; i<kAdcOversampling; i++)
+	  sum += input_->Convert(first + i, offset);
+	held_ = sum / kAdcOversampling - 32768;
+      }
+    }
+    if (path_ == PATH_FORMER) {
+      former_ += (held_ - former_ + (1 << (former_shift_ - 1))) >>
+	former_shift_;
+      return former_;
+    }
+    if (tick % kCvUpdatePeriod == 1)
+      value_ = conditioner_.Process(held_);
+    return value_;
+  }
+
+ private:
+  Path path_;
+  Input* input_;
+  CvConditioner conditioner_;
+  uint8_t former_shift_;
+  int32_t held_;
+  int32_t former_;
+  int16_t value_;
+};
+
+int main(int argc, char** argv) {
+  Input input;
+  if (argc > 1 && !input.Load(argv[1])) {
+    fprintf(stderr, "cannot read %s\n", argv[1]);
+    return 1;
+  }
+  uint64_t length = input.synthetic()
+    ? 4 * SAMPLE_RATE
+    : input.size() * SAMPLE_RATE / Input::conversion_rate();
+  if (input.synthetic())
+    printf("SYNTHETIC input (no recording given): %.1f LSB rms white "
+	   "noise, %.1f LSB of %.0fHz hum\n", kSyntheticNoise,
+	   kSyntheticHum, kHumFrequency);
+  else
+    printf("Recording %s: %zu conversions, %.2fs\n", argv[1],
+	   input.size(), static_cast<double>(length) / SAMPLE_RATE);
+  printf("Sample rate %dHz, %d conversions per burst\n\n", SAMPLE_RATE,
+	 kAdcOversampling);
+
+  double ms = 1000.0 / SAMPLE_RATE;
+  printf("%-14s %8s %8s %8s %10s %10s %10s\n", "path", "codes", "cents",
+	 "offset", "changes/s", "10-90% ms", "settle ms");
+  // the former path has no dead band: its mean is the input level, and
+  // the offset of each path is measured after the steps
+  double level = 0.0;
+  for (uint8_t p=0; p<PATH_LAST; p++) {
+    // noise on a steady input, once the filters have settled
+    Acquisition noise(static_cast<Path>(p), &input);
+    Statistics cv;
+    int16_t previous = 0;
+    uint32_t changes = 0;
+    for (uint64_t t=0; t<length; t++) {
+      int16_t x = noise.Tick(t, UINT64_MAX);
+      if (t < kStepLength)
+	continue;
+      cv.Add(x);
+      changes += x != previous;
+      previous = x;
+    }
+
+    if (p == PATH_FORMER)
+      level = cv.mean();
+    // held after the steps, against the level they lead to
+    Statistics offset;
+
+    // response to steps at random times, on the same noise
+    Statistics rise;
+    Statistics settle;
+    Random random(p + 1);
+    for (uint32_t s=0; s<kNumSteps; s++) {
+      Acquisition step(static_cast<Path>(p), &input);
+      uint64_t start = kStepLength + random.Next() % length;
+      uint64_t step_tick = start + kStepLength + random.Next() % 64;
+      double low = 0.0;
+      for (uint64_t t=start; t<step_tick; t++)
+	low = step.Tick(t, step_tick);
+      double high = low + kStep * 16.0;
+      int64_t t10 = -1;
+      int64_t t90 = -1;
+      int64_t settled = -1;
+      for (uint64_t t=step_tick; t<step_tick+kStepLength; t++) {
+	double x = step.Tick(t, step_tick);
+	if (t10 < 0 && x >= low + 0.1 * (high - low))
+	  t10 = t;
+	if (t90 < 0 && x >= low + 0.9 * (high - low))
+	  t90 = t;
+	if (t >= step_tick + kStepLength / 2)
+	  offset.Add(x - level - kStep * 16.0);
+	if (fabs(x - high) > kSettleTolerance * 16.0)
+	  settled = -1;
+	else if (settled < 0)
+	  settled = t;
+      }
+      rise.Add((t90 - t10) * ms);
+      settle.Add((settled - static_cast<int64_t>(step_tick)) * ms);
+    }
+
+    printf("%-14s %8.2f %8.3f %8.2f %10.1f %10.2f %10.2f\n", kPathNames[p],
+	   cv.deviation(), cv.deviation() * kCentsPerCode, offset.mean(),
+	   changes * static_cast<double>(SAMPLE_RATE) / cv.count(),
+	   rise.mean(), settle.mean());
+  }
+  return 0;
+}
@@ -0,0 +1,132 @@
+#!/usr/bin/python
+#
+# Copyright 2015 Matthias Puech.
+#
+# Author: Matthias Puech (matthias.puech@gmail.com)
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+# THE SOFTWARE.
+#
+# See http://creativecommons.org/licenses/MIT/ for more information.
+#
+#
+# -----------------------------------------------------------------------------
+#
+# Timing model of the PWM DAC.
+#
+# TIM1 ticks every F_CPU / SAMPLE_RATE cycles and the ISR writes the
+# compare registers of the free-running PWM timers (TIM3, TIM4) at an
+# offset from the tick, as measured by isr_write_offset. This follows
+# the counters cycle by cycle and reports, from each tick edge:
+# - when the new value becomes the active compare value (with preload,
+#   at the next PWM update event; some values are overwritten first);
+# - when the output makes its first falling edge set by the new value.
+
+from __future__ import print_function
+
+import optparse
+import random
+
+
+def simulate(options, preload):
+  tick = options.f_cpu // options.sample_rate
+  prescaler = 0 if options.sample_rate > 16384 else 1
+  period = (1 << options.resolution) * (prescaler + 1)
+  rng = random.Random(options.seed)
+  # the PWM timers are started with TIM1, but nothing keeps them in step
+  phase = rng.randrange(period)
+
+  def count(t):
+    return ((t + phase) % period) // (prescaler + 1)
+
+  def next_update(t):
+    return t + (-(t + phase)) % period
+
+  writes = []
+  for k in range(options.ticks):
+    offset = rng.randint(options.write_offset_min, options.write_offset_max)
+    writes.append((k * tick, k * tick + offset,
+                   rng.randrange(1, 1 << options.resolution)))
+
+  activation, edge = [], []
+  lost = no_edge = 0
+  previous = 0
+  for k in range(options.ticks - 1):
+    start, write, value = writes[k]
+    next_write = writes[k + 1][1]
+    # interval where the value drives the comparator
+    begin = next_update(write) if preload else write
+    end = next_update(next_write) if preload else next_write
+    if begin >= end:
+      lost += 1
+      continue
+    activation.append(begin - start)
+    # output high while the counter is below the compare value
+    if count(begin) >= value and count(begin - 1) < previous:
+      fall = begin
+    else:
+      fall = begin + (value * (prescaler + 1) - (begin + phase)) % period
+    if fall < end:
+      edge.append(fall - start)
+    else:
+      no_edge += 1
+    previous = value
+  return tick, period, lost, activation, edge, no_edge
+
+
+def summary(values):
+  if not values:
+    return 'none'
+  return 'min %5d  mean %7.1f  max %5d  jitter %5d' % (
+      min(values), sum(values) / float(len(values)), max(values),
+      max(values) - min(values))
+
+
+def main():
+  parser = optparse.OptionParser()
+  parser.add_option('--f_cpu', dest='f_cpu', default='72000000')
+  parser.add_option('--sample_rate', dest='sample_rate', default='16384')
+  parser.add_option('--resolution', dest='resolution', type='int',
+                    default=12)
+  # isr_write_offset[] of a PROFILE_ISR build
+  parser.add_option('--write_offset_min', dest='write_offset_min',
+                    type='int', default=40)
+  parser.add_option('--write_offset_max', dest='write_offset_max',
+                    type='int', default=60)
+  parser.add_option('--ticks', dest='ticks', type='int', default=100000)
+  parser.add_option('--seed', dest='seed', type='int', default=1)
+  options, _ = parser.parse_args()
+  options.f_cpu = int(options.f_cpu.rstrip('UL'))
+  options.sample_rate = int(options.sample_rate.rstrip('UL'))
+
+  for preload in [True, False]:
+    tick, period, lost, activation, edge, no_edge = simulate(
+        options, preload)
+    print('%s preload: tick %d cycles, PWM period %d cycles' % (
+        'with' if preload else 'without', tick, period))
+    print('  values overwritten before use  %5.1f%%' % (
+        lost * 100.0 / (options.ticks - 1)))
+    print('  tick to active value (cycles)  %s' % summary(activation))
+    print('  tick to output edge (cycles)   %s' % summary(edge))
+    print('  active values without an edge  %5.1f%%' % (
+        no_edge * 100.0 / (options.ticks - 1)))
+    print('')
+
+
+if __name__ == '__main__':
+  main()
@@ -0,0 +1,185 @@
+// Copyright 2015 Matthias Puech
+//
+// Author: Matthias Puech (matthias.puech@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// The firmware itself (build/batumi/batumi.elf) in an emulated STM32F103,
+// instruction by instruction (see stm32_emulator.h), on a scenario of
+// input changes: a file (--scenario=file, format in stm32_emulator.h) or
+// the default below. Reports the instructions and estimated cycles of the
+// interrupt handlers, per handler over the run and per window of the run
+// (--window, in ms) for the TIM1 tick with its headroom. These are the
+// Thumb-2 instructions of the real build, with flash wait states and
+// operand-dependent divisions, where the host tools time x86 code.
+// --trace=file writes every handler run: time (ms), handler,
+// instructions, 32-bit instructions, cycles.
+
+#include <cstdio>
+
+#include "tools/harness.h"
+#include "tools/stm32_emulator.h"
+
+using namespace batumi;
+
+// the splash animation lasts 320ms, during which the tick does not
+// process; the events come after it
+const char* kDefaultScenario =
+  "# pitches spread over the pots\n"
+  "0 pot1 800\n"
+  "0 pot2 1600\n"
+  "0 pot3 2400\n"
+  "0 pot4 3200\n"
+  "# 2ms triggers on the four resets\n"
+  "400 reset1 4095 50 20\n"
+  "402 reset1 2048 50 20\n"
+  "410 reset2 4095 50 20\n"
+  "412 reset2 2048 50 20\n"
+  "420 reset3 4095 100 10\n"
+  "422 reset3 2048 100 10\n"
+  "430 reset4 4095 100 10\n"
+  "432 reset4 2048 100 10\n"
+  "# CV steps\n"
+  "600 cv1 3000\n"
+  "700 cv2 2800\n"
+  "800 cv1 1200\n"
+  "900 cv3 3500\n"
+  "# next feature mode: short press of the tact switch\n"
+  "1000 tact 0\n"
+  "1100 tact 4095\n"
+  "1500 end\n";
+
+// resolution of the scenario
+const double kStep = 0.1;  // ms
+
+struct Run {
+  int exception;
+  Invocation invocation;
+  bool operator<(const Run& other) const {
+    return invocation.start < other.invocation.start;
+  }
+};
+
+int main(int argc, char** argv) {
+  const char* elf = Option(argc, argv, "elf", "build/batumi/batumi.elf");
+  const char* scenario_file = Option(argc, argv, "scenario",
+				     static_cast<const char*>(NULL));
+  const char* trace = Option(argc, argv, "trace",
+			     static_cast<const char*>(NULL));
+  double window = Option(argc, argv, "window", 100.0);
+
+  Scenario scenario;
+  if (!(scenario_file ? scenario.Load(scenario_file) :
+	scenario.Parse(kDefaultScenario)))
+    return 1;
+
+  Stm32Emulator emulator;
+  if (!emulator.Init() || !emulator.LoadElf(elf)) {
+    fprintf(stderr, "%s\n", emulator.error());
+    return 1;
+  }
+  emulator.Reset();
+  const double cycles_per_ms = F_CPU / 1000.0;
+  uint32_t steps = scenario.duration() / kStep;
+  for (uint32_t i=0; i<steps; i++) {
+    scenario.Apply(i * kStep, &emulator);
+    if (!emulator.RunUntil((i + 1) * kStep * cycles_per_ms)) {
+      fprintf(stderr, "%.1fms: %s\n", i * kStep, emulator.error());
+      return 1;
+    }
+  }
+
+  double duration = emulator.cycles() / cycles_per_ms;
+  printf("%s, %.0fms of %s, %ldMHz\n\n", elf, duration,
+	 scenario_file ? scenario_file : "the default scenario",
+	 F_CPU / 1000000);
+  printf("%-24s %8s %9s %7s %7s %9s %7s %7s\n", "handler", "runs/s",
+	 "instr", "max", "32-bit", "cycles", "max", "load");
+  std::vector<Run> runs;
+  for (int e=0; e<EXCEPTION_LAST; e++) {
+    const std::vector<Invocation>& invocations = emulator.invocations(e);
+    if (invocations.empty())
+      continue;
+    Statistics instructions, cycles;
+    double wide = 0.0, total = 0.0;
+    for (size_t i=0; i<invocations.size(); i++) {
+      instructions.Add(invocations[i].instructions);
+      cycles.Add(invocations[i].cycles);
+      wide += invocations[i].wide;
+      total += invocations[i].cycles;
+      Run run = { e, invocations[i] };
+      runs.push_back(run);
+    }
+    printf("%-24s %8.0f %9.1f %7.0f %6.1f%% %9.1f %7.0f %6.1f%%\n",
+	   emulator.Name(e).c_str(), invocations.size() * 1000.0 / duration,
+	   instructions.mean(), instructions.max(),
+	   100.0 * wide / (instructions.mean() * instructions.count()),
+	   cycles.mean(), cycles.max(),
+	   100.0 * total / emulator.cycles());
+  }
+  printf("%-24s %57s %6.1f%%\n", "idle (WFI)", "",
+	 100.0 * emulator.idle_cycles() / emulator.cycles());
+
+  const std::vector<Invocation>& ticks =
+    emulator.invocations(EXCEPTION_TIM1_UP);
+  if (ticks.size() > 1) {
+    double period = static_cast<double>(
+	ticks.back().start - ticks.front().start) / (ticks.size() - 1);
+    printf("\n%s, %.1f cycles per tick\n",
+	   emulator.Name(EXCEPTION_TIM1_UP).c_str(), period);
+    printf("%9s %7s %9s %7s %9s %7s %9s\n", "from (ms)", "ticks",
+	   "instr", "max", "cycles", "max", "headroom");
+    size_t i = 0;
+    for (double from=0.0; from<duration; from+=window) {
+      Statistics instructions, cycles;
+      for (; i<ticks.size() && ticks[i].start < (from + window) *
+	     cycles_per_ms; i++) {
+	instructions.Add(ticks[i].instructions);
+	cycles.Add(ticks[i].cycles);
+      }
+      if (!instructions.count())
+	continue;
+      printf("%9.0f %7d %9.1f %7.0f %9.1f %7.0f %9.0f\n", from,
+	     static_cast<int>(instructions.count()), instructions.mean(),
+	     instructions.max(), cycles.mean(), cycles.max(),
+	     period - cycles.max());
+    }
+  }
+
+  if (trace) {
+    FILE* file = fopen(trace, "w");
+    if (!file) {
+      fprintf(stderr, "cannot write %s\n", trace);
+      return 1;
+    }
+    std::sort(runs.begin(), runs.end());
+    for (size_t i=0; i<runs.size(); i++) {
+      const Invocation& run = runs[i].invocation;
+      fprintf(file, "%.4f, %s, %d, %d, %d\n", run.start / cycles_per_ms,
+	      emulator.Name(runs[i].exception).c_str(), run.instructions,
+	      run.wide, run.cycles);
+    }
+    fclose(file);
+  }
+  return 0;
+}
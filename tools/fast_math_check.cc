@@ -0,0 +1,126 @@
+// Copyright 2015 Matthias Puech
+//
+// Author: Matthias Puech (matthias.puech@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Errors of the fixed-point functions of fast_math.h against libm,
+// measured on the host, and their time against a read of the sine table.
+
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+
+#include "fast_math.h"
+#include "tables.h"
+#include "tools/harness.h"
+
+using namespace batumi;
+
+// the saturation of Tanh is at 181704: the range covers it on both sides
+const int32_t kTanhRange = 300000;
+const uint32_t kTimingFrames = 100000000;
+const uint8_t kTimingRuns = 3;
+
+int main(int argc, char** argv) {
+  // phases between two sine evaluations; odd, to visit all low bits
+  uint32_t step = Option(argc, argv, "step", 4099);
+
+  // Exp2, on every input
+  double exp2_error = 0.0;
+  uint16_t exp2_worst = 0;
+  for (uint32_t x=0; x<65536; x++) {
+    double exact = ldexp(exp2(x / 65536.0), 31);
+    double error = fabs(Exp2(x) - exact) / exact;
+    if (error > exp2_error) {
+      exp2_error = error;
+      exp2_worst = x;
+    }
+  }
+  printf("Exp2: relative error %.2g at %d\n", exp2_error, exp2_worst);
+
+  // Sine, against libm and against the table it would replace
+  double sine_error = 0.0, table_error = 0.0;
+  uint32_t sine_worst = 0;
+  for (uint64_t p=0; p<(1ULL << 32); p+=step) {
+    uint32_t phase = p;
+    double exact = 32767.0 * sin(2.0 * M_PI * phase / 4294967296.0);
+    double error = fabs(Sine(phase) - exact);
+    if (error > sine_error) {
+      sine_error = error;
+      sine_worst = phase;
+    }
+    table_error = std::max(table_error, fabs(
+	InterpolateSine1022(wav_sine.data, phase) - exact));
+  }
+  printf("Sine: error %.2f LSB at phase 0x%08x (table: %.2f LSB)\n",
+	 sine_error, sine_worst, table_error);
+  const uint32_t quadrants[] = {
+    0, 0x40000000, 0x80000000, 0xc0000000, 0xffffffff
+  };
+  printf("Sine at the quadrants:");
+  for (uint8_t i=0; i<5; i++)
+    printf(" %d", Sine(quadrants[i]));
+  printf("\n");
+
+  // Tanh, over the range then on its symmetry
+  double tanh_error = 0.0;
+  int32_t tanh_worst = 0;
+  uint32_t asymmetric = 0;
+  for (int32_t x=-kTanhRange; x<=kTanhRange; x++) {
+    double error = fabs(Tanh(x) - 32767.0 * tanh(x / 32768.0));
+    if (error > tanh_error) {
+      tanh_error = error;
+      tanh_worst = x;
+    }
+    if (Tanh(-x) != -Tanh(x))
+      asymmetric++;
+  }
+  printf("Tanh: error %.2f LSB at %d, %d asymmetric inputs, "
+	 "Tanh(INT32_MIN + 1) = %d\n", tanh_error, tanh_worst, asymmetric,
+	 Tanh(INT32_MIN + 1));
+
+  // keeps the functions from being optimized out
+  int32_t sum = 0;
+  double best_sine = 1e9, best_tanh = 1e9, best_table = 1e9;
+  for (uint8_t r=0; r<kTimingRuns; r++) {
+    clock_t start = clock();
+    for (uint32_t n=0; n<kTimingFrames; n++)
+      sum += Sine(n * 2654435761u);
+    best_sine = std::min(best_sine, static_cast<double>(clock() - start));
+    start = clock();
+    for (uint32_t n=0; n<kTimingFrames; n++)
+      sum += Tanh(static_cast<int32_t>(n * 2654435761u) >> 13);
+    best_tanh = std::min(best_tanh, static_cast<double>(clock() - start));
+    start = clock();
+    for (uint32_t n=0; n<kTimingFrames; n++)
+      sum += InterpolateSine1022(wav_sine.data, n * 2654435761u);
+    best_table = std::min(best_table, static_cast<double>(clock() - start));
+  }
+  if (sum == INT32_MIN)
+    printf("\n");
+  double ns = 1e9 / CLOCKS_PER_SEC / kTimingFrames;
+  printf("\nper call, host: Sine %.2fns, Tanh %.2fns, sine table %.2fns\n",
+	 best_sine * ns, best_tanh * ns, best_table * ns);
+  return 0;
+}
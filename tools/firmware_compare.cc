@@ -0,0 +1,330 @@
+// Copyright 2015 Matthias Puech
+//
+// Author: Matthias Puech (matthias.puech@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// The build (--elf) and the vendor image (--original, a raw image at the
+// start of the flash) side by side in two emulated STM32F103 (see
+// stm32_emulator.h), on the same scenario of input changes (--scenario,
+// or the default below). Both outputs are read at every sample period as
+// the duty cycles of the TIM3 and TIM4 compare registers, and compared
+// from --skip (ms) on: their difference in % of the full scale, and the
+// lag of the build (in samples) that minimizes it. Then the interrupt
+// cost of both images. --dump=file writes the outputs of both: time (ms),
+// then the 8 outputs of the build and the 8 of the vendor image.
+//
+// The outputs are not expected to be identical, see kExpectedDifferences.
+
+#include <cmath>
+#include <cstdio>
+
+#include "tools/harness.h"
+#include "tools/stm32_emulator.h"
+
+using namespace batumi;
+
+// the resets realign the phases, that differ after the boot
+const char* kDefaultScenario =
+  "# pitches spread over the pots\n"
+  "0 pot1 800\n"
+  "0 pot2 1600\n"
+  "0 pot3 2400\n"
+  "0 pot4 3200\n"
+  "# 2ms triggers on the four resets\n"
+  "400 reset1 4095 100 15\n"
+  "402 reset1 2048 100 15\n"
+  "400 reset2 4095 100 15\n"
+  "402 reset2 2048 100 15\n"
+  "400 reset3 4095 100 15\n"
+  "402 reset3 2048 100 15\n"
+  "400 reset4 4095 100 15\n"
+  "402 reset4 2048 100 15\n"
+  "# CV steps\n"
+  "800 cv1 3000\n"
+  "900 cv2 2800\n"
+  "1000 cv1 1200\n"
+  "1100 cv3 3500\n"
+  "# next feature mode: short press of the tact switch\n"
+  "1400 tact 0\n"
+  "1500 tact 4095\n"
+  "1900 end\n";
+
+const char* kExpectedDifferences =
+  "Expected differences\n"
+  "- the vendor image ticks from TIM3 and the ADC interrupt and reads\n"
+  "  the ADC with ADC1 alone, the build ticks from TIM1 with both ADCs\n"
+  "  in dual mode: the handlers and their rates differ\n"
+  "- the build writes the outputs at the start of the tick, the values\n"
+  "  computed by the previous one: a lag of about 1 sample\n"
+  "- the build oversamples the ADC on each mux visit and conditions the\n"
+  "  CVs (filter and hysteresis): the outputs follow a CV step later and\n"
+  "  smoother, and ignore small CV changes\n"
+  "- the build tunes to the actual tick rate, 16385.98Hz: the pitches\n"
+  "  are 0.2 cents apart, which drifts the phases between resets\n"
+  "- a reset starts a band-limited step, and the resets are queued and\n"
+  "  rendered within the tick at their time: the outputs around a reset\n"
+  "  differ for a few samples\n"
+  "- below 1Hz the build computes the shapes every 64 samples and\n"
+  "  interpolates in between: a few LSB of difference\n"
+  "- the VCO range, FM and PM modes are new, and off in erased settings;\n"
+  "  the QUAD mode sines use the table unless QUADRATURE_SINE is defined\n"
+  "- behaviour of the vendor image that is not in the sources, and\n"
+  "  peripherals it may use that are not emulated (TIM8, AFIO...), show\n"
+  "  as differences too\n";
+
+// TIM3 and TIM4 channels of the outputs (see drivers/dac.cc)
+struct Output {
+  const char* name;
+  uint8_t timer;
+  uint8_t channel;
+};
+
+const Output kOutputs[] = {
+  { "sine 1", 2, 0 },
+  { "sine 2", 2, 1 },
+  { "sine 3", 2, 2 },
+  { "sine 4", 2, 3 },
+  { "asgn 1", 3, 2 },
+  { "asgn 2", 3, 1 },
+  { "asgn 3", 3, 0 },
+  { "asgn 4", 3, 3 },
+};
+const uint8_t kNumOutputs = 8;
+
+// in samples, either way
+const uint32_t kMaxLag = 16;
+
+const uint8_t kNumImages = 2;
+const char* kImageNames[kNumImages] = { "build", "original" };
+
+// difference, in % of the full scale, between the build delayed by a lag
+// and the original, over samples [from, to)
+void Difference(const std::vector<double>& build,
+		const std::vector<double>& original,
+		size_t from, size_t to, int32_t lag,
+		double* rms, double* max) {
+  double sum = 0.0;
+  size_t count = 0;
+  *max = 0.0;
+  for (size_t i=from; i<to; i++) {
+    if (i < from + kMaxLag || i + kMaxLag >= to)
+      continue;
+    double difference = 100.0 * (build[i] - original[i - lag]);
+    sum += difference * difference;
+    *max = std::max(*max, fabs(difference));
+    count++;
+  }
+  *rms = count ? sqrt(sum / count) : 0.0;
+}
+
+// the most frequent handler besides SysTick
+int Tick(const Stm32Emulator& emulator) {
+  int tick = -1;
+  for (int e=EXCEPTION_SYSTICK+1; e<EXCEPTION_LAST; e++)
+    if (tick < 0 ||
+	emulator.invocations(e).size() > emulator.invocations(tick).size())
+      tick = e;
+  return tick;
+}
+
+int main(int argc, char** argv) {
+  const char* elf = Option(argc, argv, "elf", "build/batumi/batumi.elf");
+  const char* original = Option(argc, argv, "original",
+				"resources/original_firmware.bin");
+  const char* scenario_file = Option(argc, argv, "scenario",
+				     static_cast<const char*>(NULL));
+  const char* dump = Option(argc, argv, "dump",
+			    static_cast<const char*>(NULL));
+  double skip = Option(argc, argv, "skip", 500.0);
+  double window = Option(argc, argv, "window", 100.0);
+
+  Scenario scenarios[kNumImages];
+  for (uint8_t i=0; i<kNumImages; i++)
+    if (!(scenario_file ? scenarios[i].Load(scenario_file) :
+	  scenarios[i].Parse(kDefaultScenario)))
+      return 1;
+
+  Stm32Emulator emulators[kNumImages];
+  if (!emulators[0].Init() || !emulators[0].LoadElf(elf)) {
+    fprintf(stderr, "%s\n", emulators[0].error());
+    return 1;
+  }
+  if (!emulators[1].Init() || !emulators[1].LoadBinary(original, kFlashBase)) {
+    fprintf(stderr, "%s\n", emulators[1].error());
+    return 1;
+  }
+
+  // the outputs of both images, as duty cycles, one per sample period
+  std::vector<double> outputs[kNumImages][kNumOutputs];
+  const double cycles_per_ms = F_CPU / 1000.0;
+  const double cycles_per_sample = static_cast<double>(F_CPU) / SAMPLE_RATE;
+  uint32_t samples = scenarios[0].duration() * cycles_per_ms /
+    cycles_per_sample;
+  for (uint8_t i=0; i<kNumImages; i++) {
+    emulators[i].Reset();
+    for (uint8_t j=0; j<kNumOutputs; j++)
+      outputs[i][j].reserve(samples);
+  }
+  for (uint32_t n=0; n<samples; n++) {
+    for (uint8_t i=0; i<kNumImages; i++) {
+      Stm32Emulator* emulator = &emulators[i];
+      scenarios[i].Apply(n * cycles_per_sample / cycles_per_ms, emulator);
+      if (!emulator->RunUntil((n + 1) * cycles_per_sample)) {
+	fprintf(stderr, "%s, %.1fms: %s\n", kImageNames[i],
+		n * cycles_per_sample / cycles_per_ms, emulator->error());
+	return 1;
+      }
+      for (uint8_t j=0; j<kNumOutputs; j++) {
+	const Output& output = kOutputs[j];
+	outputs[i][j].push_back(
+	    std::min(1.0, static_cast<double>(
+		emulator->compare(output.timer, output.channel)) /
+		emulator->period(output.timer)));
+      }
+    }
+  }
+
+  double duration = samples * cycles_per_sample / cycles_per_ms;
+  printf("%s against %s, %.0fms of %s, compared from %.0fms\n\n", elf,
+	 original, duration,
+	 scenario_file ? scenario_file : "the default scenario", skip);
+
+  size_t from = std::min<size_t>(samples, skip * cycles_per_ms /
+				 cycles_per_sample);
+  printf("%-8s %9s %9s %8s %8s %5s %8s\n", "output", "build/s", "orig/s",
+	 "rms (%)", "max", "lag", "at lag");
+  for (uint8_t j=0; j<kNumOutputs; j++) {
+    const Output& output = kOutputs[j];
+    double rms, max;
+    Difference(outputs[0][j], outputs[1][j], from, samples, 0, &rms, &max);
+    int32_t best_lag = 0;
+    double best_rms = rms;
+    for (int32_t lag=-int32_t(kMaxLag); lag<=int32_t(kMaxLag); lag++) {
+      double lag_rms, lag_max;
+      Difference(outputs[0][j], outputs[1][j], from, samples, lag,
+		 &lag_rms, &lag_max);
+      if (lag_rms < best_rms) {
+	best_lag = lag;
+	best_rms = lag_rms;
+      }
+    }
+    printf("%-8s %9.0f %9.0f %8.2f %8.2f %5d %8.2f\n", output.name,
+	   emulators[0].compare_writes(output.timer, output.channel) *
+	   1000.0 / duration,
+	   emulators[1].compare_writes(output.timer, output.channel) *
+	   1000.0 / duration,
+	   rms, max, best_lag, best_rms);
+  }
+
+  // the worst output per window, without lag, to place the differences
+  // in the scenario
+  printf("\n%9s %8s %8s\n", "from (ms)", "rms (%)", "output");
+  for (double time=skip; time<duration; time+=window) {
+    size_t start = time * cycles_per_ms / cycles_per_sample;
+    size_t end = std::min<size_t>(
+	samples, (time + window) * cycles_per_ms / cycles_per_sample);
+    if (end <= start + 2 * kMaxLag)
+      continue;
+    double worst = 0.0;
+    uint8_t worst_output = 0;
+    for (uint8_t j=0; j<kNumOutputs; j++) {
+      double rms, max;
+      Difference(outputs[0][j], outputs[1][j], start, end, 0, &rms, &max);
+      if (rms > worst) {
+	worst = rms;
+	worst_output = j;
+      }
+    }
+    printf("%9.0f %8.2f %8s\n", time, worst, kOutputs[worst_output].name);
+  }
+
+  for (uint8_t i=0; i<kNumImages; i++) {
+    const Stm32Emulator& emulator = emulators[i];
+    printf("\n%s\n", kImageNames[i]);
+    printf("%-24s %8s %9s %7s %7s\n", "handler", "runs/s", "cycles", "max",
+	   "load");
+    for (int e=0; e<EXCEPTION_LAST; e++) {
+      const std::vector<Invocation>& invocations = emulator.invocations(e);
+      if (invocations.empty())
+	continue;
+      Statistics cycles;
+      double total = 0.0;
+      for (size_t k=0; k<invocations.size(); k++) {
+	cycles.Add(invocations[k].cycles);
+	total += invocations[k].cycles;
+      }
+      printf("%-24s %8.0f %9.1f %7.0f %6.1f%%\n",
+	     emulators[i].Name(e).c_str(),
+	     invocations.size() * 1000.0 / duration, cycles.mean(),
+	     cycles.max(), 100.0 * total / emulator.cycles());
+    }
+  }
+
+  // the handlers of the vendor image have no symbols; its tick is taken
+  // as its most frequent handler
+  printf("\n%-34s %14s %14s\n", "", kImageNames[0], kImageNames[1]);
+  double ticks[kNumImages], tick_mean[kNumImages], tick_max[kNumImages];
+  double handlers[kNumImages], idle[kNumImages];
+  for (uint8_t i=0; i<kNumImages; i++) {
+    const Stm32Emulator& emulator = emulators[i];
+    int tick = Tick(emulator);
+    Statistics cycles;
+    for (size_t k=0; k<emulator.invocations(tick).size(); k++)
+      cycles.Add(emulator.invocations(tick)[k].cycles);
+    ticks[i] = cycles.count() * 1000.0 / duration;
+    tick_mean[i] = cycles.count() ? cycles.mean() : 0.0;
+    tick_max[i] = cycles.count() ? cycles.max() : 0.0;
+    handlers[i] = 0.0;
+    for (int e=0; e<EXCEPTION_LAST; e++)
+      for (size_t k=0; k<emulator.invocations(e).size(); k++)
+	handlers[i] += emulator.invocations(e)[k].cycles;
+    idle[i] = 100.0 * emulator.idle_cycles() / emulator.cycles();
+  }
+  printf("%-34s %14.0f %14.0f\n", "ticks/s", ticks[0], ticks[1]);
+  printf("%-34s %14.1f %14.1f\n", "cycles per tick", tick_mean[0],
+	 tick_mean[1]);
+  printf("%-34s %14.0f %14.0f\n", "max", tick_max[0], tick_max[1]);
+  printf("%-34s %14.1f %14.1f\n", "handler cycles per sample period",
+	 handlers[0] / samples, handlers[1] / samples);
+  printf("%-34s %13.1f%% %13.1f%%\n", "idle (WFI)", idle[0], idle[1]);
+
+  printf("\n%s", kExpectedDifferences);
+
+  if (dump) {
+    FILE* file = fopen(dump, "w");
+    if (!file) {
+      fprintf(stderr, "cannot write %s\n", dump);
+      return 1;
+    }
+    for (uint32_t n=0; n<samples; n++) {
+      fprintf(file, "%.4f", n * cycles_per_sample / cycles_per_ms);
+      for (uint8_t i=0; i<kNumImages; i++)
+	for (uint8_t j=0; j<kNumOutputs; j++)
+	  fprintf(file, ", %.5f", outputs[i][j][n]);
+      fprintf(file, "\n");
+    }
+    fclose(file);
+  }
+  return 0;
+}
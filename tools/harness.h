@@ -0,0 +1,231 @@
+// Copyright 2015 Matthias Puech
+//
+// Author: Matthias Puech (matthias.puech@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Shared helpers of the host measurement tools: reproducible stimuli,
+// options, statistics, the cadence of the ADC mux and windowed spectra.
+
+#ifndef BATUMI_TOOLS_HARNESS_H_
+#define BATUMI_TOOLS_HARNESS_H_
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstring>
+#include <vector>
+
+#include "drivers/adc.h"
+#include "processor.h"
+
+namespace batumi {
+
+// xorshift32: the same stimuli on every run
+class Random {
+ public:
+  explicit Random(uint32_t seed) : state_(seed ? seed : 1) { }
+
+  inline uint32_t Next() {
+    state_ ^= state_ << 13;
+    state_ ^= state_ >> 17;
+    state_ ^= state_ << 5;
+    return state_;
+  }
+
+  // in [0, 1)
+  inline double Uniform() {
+    return Next() / 4294967296.0;
+  }
+
+  inline double Gaussian() {
+    double u = 1.0 - Uniform();
+    return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * Uniform());
+  }
+
+ private:
+  uint32_t state_;
+};
+
+// value of --name=value on the command line, or NULL
+inline const char* FindOption(int argc, char** argv, const char* name) {
+  size_t length = strlen(name);
+  for (int i=1; i<argc; i++)
+    if (!strncmp(argv[i], "--", 2) &&
+	!strncmp(argv[i] + 2, name, length) &&
+	argv[i][2 + length] == '=')
+      return argv[i] + 3 + length;
+  return NULL;
+}
+
+inline double Option(int argc, char** argv, const char* name, double value) {
+  const char* option = FindOption(argc, argv, name);
+  return option ? atof(option) : value;
+}
+
+inline const char* Option(int argc, char** argv, const char* name,
+			  const char* value) {
+  const char* option = FindOption(argc, argv, name);
+  return option ? option : value;
+}
+
+class Statistics {
+ public:
+  Statistics() { }
+
+  inline void Add(double x) { values_.push_back(x); }
+  inline size_t count() const { return values_.size(); }
+
+  double min() const {
+    return *std::min_element(values_.begin(), values_.end());
+  }
+  double max() const {
+    return *std::max_element(values_.begin(), values_.end());
+  }
+  double mean() const {
+    double sum = 0.0;
+    for (size_t i=0; i<values_.size(); i++)
+      sum += values_[i];
+    return sum / values_.size();
+  }
+  double deviation() const {
+    double m = mean();
+    double sum = 0.0;
+    for (size_t i=0; i<values_.size(); i++)
+      sum += (values_[i] - m) * (values_[i] - m);
+    return sqrt(sum / values_.size());
+  }
+  // p in [0, 1], nearest rank
+  double Percentile(double p) const {
+    std::vector<double> sorted(values_);
+    std::sort(sorted.begin(), sorted.end());
+    return sorted[static_cast<size_t>(p * (sorted.size() - 1) + 0.5)];
+  }
+
+ private:
+  std::vector<double> values_;
+};
+
+// The ADC mux as sequenced by drivers/adc.cc: a burst of conversions is
+// started on one tick and read on the next, then the mux moves on to the
+// next of its 8 positions. The CVs sit on the first 4 positions and the
+// reset inputs on the last 4: each input is sampled every 16 ticks and
+// held in between.
+class Mux {
+ public:
+  Mux() : position_(0), converting_(false), sampled_(0) {
+    for (uint8_t i=0; i<kNumAdcChannels; i++)
+      values_[i] = 0;
+  }
+
+  // one tick, with the analog inputs (CVs then resets) at its start;
+  // fills the processor input as batumi.cc does
+  void Tick(const int16_t* analog, ProcessorInput* input) {
+    uint8_t read = kNumAdcChannels;
+    if (converting_) {
+      values_[position_] = sampled_;
+      read = position_;
+      position_ = (position_ + 1) % kNumAdcChannels;
+    } else {
+      sampled_ = analog[position_];
+    }
+    converting_ = !converting_;
+
+    for (uint8_t i=0; i<kNumChannels; i++) {
+      input->cv[i] = values_[i];
+      input->reset[i] = values_[kNumChannels + i];
+    }
+    input->cv_updated = read < kNumChannels ? 1 << read : 0;
+  }
+
+ private:
+  uint8_t position_;
+  bool converting_;
+  int16_t sampled_;
+  int16_t values_[kNumAdcChannels];
+};
+
+// in place, radix 2
+inline void Fft(std::vector<std::complex<double> >* x) {
+  size_t n = x->size();
+  for (size_t i=1, j=0; i<n; i++) {
+    size_t bit = n >> 1;
+    for (; j & bit; bit >>= 1)
+      j ^= bit;
+    j ^= bit;
+    if (i < j)
+      std::swap((*x)[i], (*x)[j]);
+  }
+  for (size_t length=2; length<=n; length <<= 1) {
+    std::complex<double> w = std::polar(1.0, -2.0 * M_PI / length);
+    for (size_t i=0; i<n; i+=length) {
+      std::complex<double> wk = 1.0;
+      for (size_t k=0; k<length/2; k++) {
+	std::complex<double> a = (*x)[i + k];
+	std::complex<double> b = (*x)[i + k + length/2] * wk;
+	(*x)[i + k] = a + b;
+	(*x)[i + k + length/2] = a - b;
+	wk *= w;
+      }
+    }
+  }
+}
+
+// Power spectrum (bins 0 to size/2) under a 4-term Blackman-Harris
+// window, whose sidelobes stay 92dB down. A sinusoid of amplitude A
+// spreads over +/-4 bins, of total power A^2 * window_power / 4.
+class Spectrum {
+ public:
+  explicit Spectrum(size_t size) : window_(size), power_(size / 2 + 1) {
+    window_power_ = 0.0;
+    for (size_t i=0; i<size; i++) {
+      double x = 2.0 * M_PI * i / size;
+      window_[i] = 0.35875 - 0.48829 * cos(x) + 0.14128 * cos(2 * x)
+	- 0.01168 * cos(3 * x);
+      window_power_ += window_[i] * window_[i];
+    }
+    window_power_ *= size;
+  }
+
+  void Analyze(const std::vector<double>& signal) {
+    std::vector<std::complex<double> > x(window_.size());
+    for (size_t i=0; i<window_.size(); i++)
+      x[i] = signal[i] * window_[i];
+    Fft(&x);
+    for (size_t i=0; i<power_.size(); i++)
+      power_[i] = std::norm(x[i]);
+  }
+
+  inline size_t size() const { return window_.size(); }
+  inline double power(size_t bin) const { return power_[bin]; }
+  inline double window_power() const { return window_power_; }
+
+ private:
+  std::vector<double> window_;
+  std::vector<double> power_;
+  double window_power_;
+};
+
+}  // namespace batumi
+
+#endif  // BATUMI_TOOLS_HARNESS_H_
@@ -0,0 +1,340 @@
+// Copyright 2015 Matthias Puech
+//
+// Author: Matthias Puech (matthias.puech@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Search for the worst-case cost of one tick of the processor, on the
+// host. A fixture is a run of frames (parameters and analog inputs,
+// read through the ADC mux); its cost is the largest number of basic
+// blocks run by a single Process call. The engine is built with
+// -fsanitize-coverage=trace-pc (build/libbatumi_coverage), so the count
+// is exact and does not depend on the load of the host, unlike its
+// clock. The same instrumentation gives the coverage: fixtures reaching
+// new blocks, or running one a new range of times, join
+// the corpus the mutations start from. The costliest fixture is saved
+// with --output=file, to be replayed with --replay=file.
+
+#include <cstdio>
+#include <vector>
+
+#include "processor.h"
+#include "tools/harness.h"
+
+using namespace batumi;
+
+const uint16_t kNumFrames = 64;
+// the parameters follow the UI, which is polled every millisecond
+const uint16_t kFramesPerParameters = 16;
+const uint16_t kNumSegments = kNumFrames / kFramesPerParameters;
+// frames of the first parameters before the fixture, at rest
+const uint16_t kWarmUp = 256;
+const int32_t kDefaultCvScale = 2 * 5 * kOctave;
+
+// blocks are hashed from their address into this many counters
+const uint32_t kCoverageSize = 1 << 16;
+
+struct Fixture {
+  ProcessorParameters parameters[kNumSegments];
+  int16_t analog[kNumFrames][kNumAdcChannels];
+};
+
+Processor processor;
+
+ProcessorParameters RandomParameters(Random* random) {
+  ProcessorParameters p = { };
+  p.feat_mode = static_cast<FeatureMode>(random->Next() % FEAT_MODE_LAST);
+  p.range = static_cast<FrequencyRange>(random->Next() % RANGE_LAST);
+  p.cv_mode = static_cast<CvMode>(random->Next() % CV_MODE_LAST);
+  p.shape = random->Next() % 4;
+  p.sync_mode = random->Next() % 2;
+  for (uint8_t i=0; i<kNumChannels; i++) {
+    p.coarse[i] = random->Next();
+    p.fine[i] = random->Next();
+    p.cv_scale[i] = kDefaultCvScale;
+    p.cv_offset[i] = 0;
+  }
+  return p;
+}
+
+int16_t RandomAnalog(Random* random) {
+  // mostly the ends of the range, where the resets trigger
+  switch (random->Next() % 4) {
+  case 0: return INT16_MIN;
+  case 1: return INT16_MAX;
+  default: return random->Next();
+  }
+}
+
+void Mutate(Fixture* f, Random* random) {
+  uint8_t n = 1 + random->Next() % 8;
+  while (n--) {
+    uint16_t frame = random->Next() % kNumFrames;
+    uint8_t channel = random->Next() % kNumChannels;
+    ProcessorParameters* p = &f->parameters[random->Next() % kNumSegments];
+    switch (random->Next() % 8) {
+    case 0:
+      *p = RandomParameters(random);
+      break;
+    case 1:
+      p->coarse[channel] = random->Next();
+      break;
+    case 2:
+      p->feat_mode = static_cast<FeatureMode>(
+	  random->Next() % FEAT_MODE_LAST);
+      break;
+    case 3:
+      p->cv_mode = static_cast<CvMode>(random->Next() % CV_MODE_LAST);
+      p->range = static_cast<FrequencyRange>(random->Next() % RANGE_LAST);
+      break;
+    case 4:
+      // a reset edge on every channel
+      for (uint8_t i=0; i<kNumChannels; i++)
+	f->analog[frame][kNumChannels + i] =
+	  f->analog[frame][kNumChannels + i] > 0 ? INT16_MIN : INT16_MAX;
+      break;
+    default:
+      f->analog[frame][random->Next() % kNumAdcChannels] =
+	RandomAnalog(random);
+      break;
+    }
+  }
+}
+
+// Called by the instrumented engine at the start of each basic block.
+uint32_t block_counts[kCoverageSize];
+uint32_t num_blocks;
+
+extern "C" void __sanitizer_cov_trace_pc() {
+  uintptr_t pc = reinterpret_cast<uintptr_t>(__builtin_return_address(0));
+  block_counts[(pc ^ (pc >> 16)) & (kCoverageSize - 1)]++;
+  num_blocks++;
+}
+
+// Blocks seen so far, with one bit per range of their count in a run
+// (1, 2, 3, 4-7, 8-15, 16-31, 32-127, 128 and more, as in AFL), so that
+// longer loops count as new coverage too.
+uint8_t coverage[kCoverageSize];
+
+inline uint8_t Bucket(uint32_t count) {
+  if (count < 4)
+    return 1 << (count - 1);
+  if (count < 32)
+    return 1 << (32 - __builtin_clz(count));
+  return count < 128 ? 1 << 6 : 1 << 7;
+}
+
+// The costliest Process call of the fixture, in blocks, and its frame;
+// true when the run reaches new coverage
+bool Run(const Fixture& f, uint32_t* cost, uint16_t* worst_frame) {
+  memset(block_counts, 0, sizeof(block_counts));
+  // from the state at power-up, the processor being in .bss
+  memset(static_cast<void*>(&processor), 0, sizeof(processor));
+  processor.Init(SAMPLE_RATE);
+  Mux mux;
+  ProcessorInput input;
+  ProcessorOutput output;
+  int16_t rest[kNumAdcChannels] = { };
+  for (uint16_t n=0; n<kWarmUp; n++) {
+    mux.Tick(rest, &input);
+    processor.Process(f.parameters[0], &input, &output, 1);
+  }
+  *cost = 0;
+  for (uint16_t n=0; n<kNumFrames; n++) {
+    mux.Tick(f.analog[n], &input);
+    const ProcessorParameters& p = f.parameters[n / kFramesPerParameters];
+    uint32_t start = num_blocks;
+    processor.Process(p, &input, &output, 1);
+    if (num_blocks - start > *cost) {
+      *cost = num_blocks - start;
+      *worst_frame = n;
+    }
+  }
+
+  bool new_coverage = false;
+  for (uint32_t i=0; i<kCoverageSize; i++) {
+    if (!block_counts[i])
+      continue;
+    uint8_t bucket = Bucket(block_counts[i]);
+    if (!(coverage[i] & bucket)) {
+      coverage[i] |= bucket;
+      new_coverage = true;
+    }
+  }
+  return new_coverage;
+}
+
+bool Save(const Fixture& f, const char* path) {
+  FILE* file = fopen(path, "w");
+  if (!file)
+    return false;
+  fprintf(file, "# feat_mode range cv_mode shape sync_mode, then coarse "
+	  "fine cv_scale cv_offset per channel\n");
+  for (uint16_t s=0; s<kNumSegments; s++) {
+    const ProcessorParameters& p = f.parameters[s];
+    fprintf(file, "%d %d %d %d %d", p.feat_mode, p.range, p.cv_mode,
+	    p.shape, p.sync_mode);
+    for (uint8_t i=0; i<kNumChannels; i++)
+      fprintf(file, "  %d %d %d %d", p.coarse[i], p.fine[i], p.cv_scale[i],
+	      p.cv_offset[i]);
+    fprintf(file, "\n");
+  }
+  fprintf(file, "# analog inputs per frame: CVs then resets\n");
+  for (uint16_t n=0; n<kNumFrames; n++) {
+    for (uint8_t i=0; i<kNumAdcChannels; i++)
+      fprintf(file, "%d ", f.analog[n][i]);
+    fprintf(file, "\n");
+  }
+  fclose(file);
+  return true;
+}
+
+// reads the next integer, skipping the comments
+bool Read(FILE* file, int32_t* value) {
+  int c;
+  while ((c = fgetc(file)) == '#')
+    while ((c = fgetc(file)) != '\n' && c != EOF) { }
+  if (c == EOF)
+    return false;
+  ungetc(c, file);
+  return fscanf(file, " %d ", value) == 1;
+}
+
+bool Load(Fixture* f, const char* path) {
+  FILE* file = fopen(path, "r");
+  if (!file)
+    return false;
+  bool ok = true;
+  int32_t v[5 + 4 * kNumChannels];
+  for (uint16_t s=0; s<kNumSegments && ok; s++) {
+    for (uint8_t i=0; i<5 + 4 * kNumChannels && ok; i++)
+      ok = Read(file, &v[i]);
+    ProcessorParameters* p = &f->parameters[s];
+    p->feat_mode = static_cast<FeatureMode>(v[0] % FEAT_MODE_LAST);
+    p->range = static_cast<FrequencyRange>(v[1] % RANGE_LAST);
+    p->cv_mode = static_cast<CvMode>(v[2] % CV_MODE_LAST);
+    p->shape = v[3];
+    p->sync_mode = v[4];
+    for (uint8_t i=0; i<kNumChannels; i++) {
+      p->coarse[i] = v[5 + 4 * i];
+      p->fine[i] = v[6 + 4 * i];
+      p->cv_scale[i] = v[7 + 4 * i];
+      p->cv_offset[i] = v[8 + 4 * i];
+    }
+  }
+  for (uint16_t n=0; n<kNumFrames && ok; n++) {
+    for (uint8_t i=0; i<kNumAdcChannels && ok; i++) {
+      ok = Read(file, &v[0]);
+      f->analog[n][i] = v[0];
+    }
+  }
+  fclose(file);
+  return ok;
+}
+
+const char* kModeNames[] = { "FREE", "QUAD", "PHASE", "DIVIDE" };
+
+int main(int argc, char** argv) {
+  uint32_t iterations = Option(argc, argv, "iterations", 20000);
+  Random random(Option(argc, argv, "seed", 1));
+  const char* replay = Option(argc, argv, "replay", (const char*) NULL);
+  const char* output = Option(argc, argv, "output", (const char*) NULL);
+  uint32_t cost;
+  uint16_t frame = 0;
+
+  static Fixture worst;
+  if (replay) {
+    if (!Load(&worst, replay)) {
+      fprintf(stderr, "cannot read %s\n", replay);
+      return 1;
+    }
+    Run(worst, &cost, &frame);
+    printf("%s: %u blocks on frame %d, %s\n", replay, cost, frame,
+	   kModeNames[worst.parameters[frame / kFramesPerParameters].feat_mode]);
+    return 0;
+  }
+
+  // FREE mode at rest, for scale
+  static Fixture fixture;
+  for (uint16_t s=0; s<kNumSegments; s++) {
+    for (uint8_t i=0; i<kNumChannels; i++)
+      fixture.parameters[s].cv_scale[i] = kDefaultCvScale;
+  }
+  Run(fixture, &cost, &frame);
+  if (!num_blocks) {
+    fprintf(stderr, "the engine is not instrumented: link it built with "
+	    "-fsanitize-coverage=trace-pc\n");
+    return 1;
+  }
+  printf("Cost of a tick in basic blocks, at most %u in FREE mode at rest\n",
+	 cost);
+  std::vector<Fixture> corpus(1, fixture);
+
+  for (uint16_t s=0; s<kNumSegments; s++)
+    fixture.parameters[s] = RandomParameters(&random);
+  for (uint16_t n=0; n<kNumFrames; n++)
+    for (uint8_t i=0; i<kNumAdcChannels; i++)
+      fixture.analog[n][i] = RandomAnalog(&random);
+  worst = fixture;
+  uint32_t worst_cost;
+  if (Run(worst, &worst_cost, &frame))
+    corpus.push_back(worst);
+  for (uint32_t i=0; i<iterations; i++) {
+    // from the worst fixture half of the time, else from the corpus
+    fixture = random.Next() % 2 ? worst : corpus[random.Next() %
+						  corpus.size()];
+    Mutate(&fixture, &random);
+    uint16_t f;
+    if (Run(fixture, &cost, &f))
+      corpus.push_back(fixture);
+    // ties are accepted, to drift across plateaus
+    if (cost >= worst_cost) {
+      if (cost > worst_cost)
+	printf("iteration %5d: %u blocks on frame %d, %s (corpus %d)\n", i,
+	       cost, f, kModeNames[
+		   fixture.parameters[f / kFramesPerParameters].feat_mode],
+	       static_cast<int>(corpus.size()));
+      worst = fixture;
+      worst_cost = cost;
+      frame = f;
+    }
+  }
+
+  uint32_t covered = 0;
+  for (uint32_t i=0; i<kCoverageSize; i++)
+    covered += coverage[i] != 0;
+  printf("worst: %u blocks on frame %d, %s; %u blocks covered, corpus %d\n",
+	 worst_cost, frame,
+	 kModeNames[worst.parameters[frame / kFramesPerParameters].feat_mode],
+	 covered, static_cast<int>(corpus.size()));
+  if (!output) {
+    printf("not saved, see --output=file\n");
+    return 0;
+  }
+  if (!Save(worst, output)) {
+    fprintf(stderr, "cannot write %s\n", output);
+    return 1;
+  }
+  printf("saved to %s\n", output);
+  return 0;
+}
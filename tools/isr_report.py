@@ -0,0 +1,638 @@
+#!/usr/bin/python
+#
+# Copyright 2015 Matthias Puech.
+#
+# Author: Matthias Puech (matthias.puech@gmail.com)
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+# THE SOFTWARE.
+#
+# See http://creativecommons.org/licenses/MIT/ for more information.
+#
+# -----------------------------------------------------------------------------
+#
+# Worst-case stack depth and execution time of the interrupt handlers.
+#
+# Stack frames come from the call graphs written by gcc with
+# -fcallgraph-info=su. Execution times are a static estimate on the
+# disassembly of the final ELF: the longest path through each function,
+# every instruction costing its worst-case Cortex-M3 cycle count, loops
+# being multiplied by the bounds of LOOP_BOUNDS and calls by the cost of
+# their callee. Loops are identified by the source line of their back
+# edge, so that the bounds survive inlining; a loop without a bound fails
+# the report.
+
+from __future__ import print_function
+
+import glob
+import optparse
+import os
+import re
+import subprocess
+import sys
+
+# Maximum number of iterations of a loop, by a pattern of the source line
+# of its back edge (the loop statement). The first match counts.
+LOOP_BOUNDS = [
+  # the ISR passes one frame per tick to Processor::Process: one chunk,
+  # one segment, one sample rendered
+  (r'while \(size', 1),
+  (r'n < block_size', 1),
+  (r'n<size', 1),
+  # each reset input makes at most one event per sample
+  (r'e < num_events_', 4),
+  (r'<\s*kNumChannels', 4),
+  # shapes saved by Lfo::Reset and rendered by Lfo::UpdateRendering
+  (r'<\s*kNumLfoShapes', 5),
+  # octaves of an int16_t pitch, in Lfo::ComputePhaseIncrement
+  (r'while \(pitch', 22),
+  # conversions averaged by Adc::Scan
+  (r'<\s*kAdcOversampling', 8),
+  (r'<\s*kNumSwitches', 4),
+  (r'<\s*kNumLeds', 4),
+  (r'i < 4;', 4),
+]
+
+# Loops of functions compiled without line information, by function.
+LIBRARY_LOOP_BOUNDS = {
+  # struct copies, ProcessorParameters being the largest (48 bytes)
+  'memcpy': 48,
+}
+
+HANDLERS = ['TIM1_UP_IRQHandler', 'SysTick_Handler']
+
+# Exception entry and exit, including the flash wait states on the
+# vector fetch.
+EXCEPTION_CYCLES = 24
+EXCEPTION_FRAME = 32
+
+# Worst-case cycle counts with two flash wait states (72 MHz); a taken
+# branch refills the pipeline.
+BRANCH_CYCLES = 4
+CYCLES = {
+  'ldr': 2, 'ldrb': 2, 'ldrh': 2, 'ldrsb': 2, 'ldrsh': 2, 'ldrd': 3,
+  'str': 2, 'strb': 2, 'strh': 2, 'strd': 3,
+  'mla': 2, 'mls': 2,
+  'smull': 5, 'umull': 5, 'smlal': 7, 'umlal': 7,
+  'sdiv': 12, 'udiv': 12,
+  'tbb': 2 + BRANCH_CYCLES, 'tbh': 2 + BRANCH_CYCLES,
+}
+
+CONDITIONS = ['eq', 'ne', 'cs', 'hs', 'cc', 'lo', 'mi', 'pl', 'vs', 'vc',
+              'hi', 'ls', 'ge', 'lt', 'gt', 'le']
+
+FUNCTION = re.compile(r'^([0-9a-f]+) <([^>]+)>:$')
+LINE = re.compile(r'^\s*([0-9a-f]+):\s+([0-9a-f]{2,8}(?: [0-9a-f]{4})?)\s+'
+                  r'(\S+)\s*(.*)$')
+TARGET = re.compile(r'\b([0-9a-f]+) <([^>+]+)(?:\+0x[0-9a-f]+)?>')
+CI_NODE = re.compile(r'node: \{ title: "([^"]+)" label: "[^"]*\\n(\d+) bytes '
+                     r'\(([a-z,]+)\)"')
+CI_EDGE = re.compile(r'edge: \{ sourcename: "([^"]+)" targetname: "([^"]+)"')
+SECTION = re.compile(r'^\s*\d+\s+(\S+)\s+([0-9a-f]+)\s+([0-9a-f]+)\s')
+SOURCE = re.compile(r'^(\S+):(\d+)(?: \(discriminator \d+\))?$')
+
+warnings = []
+errors = []
+
+
+def warn(message):
+  if message not in warnings:
+    warnings.append(message)
+
+
+def error(message):
+  if message not in errors:
+    errors.append(message)
+
+
+def strip_suffix(mnemonic):
+  for suffix in ['.n', '.w']:
+    if mnemonic.endswith(suffix):
+      return mnemonic[:-len(suffix)]
+  return mnemonic
+
+
+def strip_condition(mnemonic):
+  for condition in CONDITIONS:
+    if mnemonic.endswith(condition) and len(mnemonic) > len(condition):
+      return mnemonic[:-len(condition)], True
+  return mnemonic, False
+
+
+def register_list(operands):
+  match = re.search(r'\{([^}]*)\}', operands)
+  if not match:
+    return []
+  registers = []
+  for item in match.group(1).split(','):
+    item = item.strip()
+    if '-' in item:
+      first, last = [int(r[1:]) for r in item.split('-')]
+      registers += ['r%d' % r for r in range(first, last + 1)]
+    elif item:
+      registers.append(item)
+  return registers
+
+
+class Instruction(object):
+
+  def __init__(self, address, size, mnemonic, operands):
+    self.address = address
+    self.size = size
+    self.mnemonic = mnemonic
+    self.operands = operands
+    self.source = None
+    self.target = None
+    self.target_name = None
+    match = TARGET.search(operands)
+    if match:
+      self.target = int(match.group(1), 16)
+      self.target_name = match.group(2)
+
+    base = strip_suffix(mnemonic)
+    registers = register_list(operands)
+    self.kind = 'plain'
+    if base in ['bl', 'blx']:
+      self.kind = 'call' if self.target is not None else 'indirect'
+    elif base in ['cbz', 'cbnz']:
+      self.kind = 'cond_branch'
+    elif base == 'b':
+      self.kind = 'branch'
+    elif base.startswith('b') and base[1:] in CONDITIONS:
+      self.kind = 'cond_branch'
+    elif base.startswith('bx'):
+      self.kind = 'return' if base == 'bx' else 'cond_return'
+    elif base in ['tbb', 'tbh']:
+      self.kind = 'table'
+    elif (base.startswith('pop') or base.startswith('ldm')) and \
+          'pc' in registers:
+      self.kind = 'return' if base in ['pop', 'ldm', 'ldmia'] \
+          else 'cond_return'
+    elif base.startswith('ldr') and operands.startswith('pc'):
+      self.kind = 'return'
+
+    name, _ = strip_condition(base)
+    if self.kind in ['call', 'indirect', 'branch', 'cond_branch']:
+      self.cycles = BRANCH_CYCLES
+    elif self.kind in ['return', 'cond_return']:
+      self.cycles = BRANCH_CYCLES + len(registers)
+    elif name.startswith('push') or name.startswith('stm') or \
+          name.startswith('pop') or name.startswith('ldm'):
+      self.cycles = 1 + len(registers)
+    else:
+      self.cycles = CYCLES.get(name, CYCLES.get(base, 1))
+
+
+class Block(object):
+
+  def __init__(self, instructions):
+    self.instructions = instructions
+    self.address = instructions[0].address
+    self.end = instructions[-1].address + instructions[-1].size
+    self.successors = []
+    self.cycles = sum(i.cycles for i in instructions)
+    self.calls = [i.target_name for i in instructions
+                  if i.kind == 'call' or (i.kind == 'branch' and
+                                          i.target_name is not None and
+                                          i.tail_call)]
+
+
+class Function(object):
+
+  def __init__(self, name, address):
+    self.name = name
+    self.address = address
+    self.instructions = []
+    self.data = {}
+    self.end = address
+
+  def add_data(self, address, raw):
+    raw = raw.replace(' ', '')
+    size = len(raw) // 2
+    value = int(raw, 16)
+    for i in range(size):
+      self.data[address + i] = (value >> (8 * i)) & 0xff
+    self.end = max(self.end, address + size)
+
+  def table_targets(self, instruction, next_code):
+    start = instruction.address + instruction.size
+    entry_size = 1 if instruction.mnemonic.startswith('tbb') else 2
+    targets = []
+    address = start
+    while address + entry_size <= next_code:
+      if address not in self.data:
+        break
+      offset = self.data[address]
+      if entry_size == 2:
+        offset |= self.data.get(address + 1, 0) << 8
+      target = start + 2 * offset
+      if self.address <= target < self.end:
+        targets.append(target)
+      address += entry_size
+    if not targets:
+      warn('%s: unresolved jump table at %x' % (self.name, instruction.address))
+    return targets
+
+  def build(self):
+    self.instructions.sort(key=lambda i: i.address)
+    code = self.instructions
+    for i in code:
+      i.tail_call = i.kind == 'branch' and i.target is not None and \
+          not (self.address <= i.target < self.end)
+    leaders = set([self.address])
+    tables = {}
+    for n, i in enumerate(code):
+      next_code = code[n + 1].address if n + 1 < len(code) else self.end
+      if i.kind == 'table':
+        tables[i.address] = self.table_targets(i, next_code)
+        leaders.update(tables[i.address])
+      if i.kind in ['branch', 'cond_branch'] and not i.tail_call and \
+            i.target is not None:
+        leaders.add(i.target)
+      if i.kind not in ['plain', 'call']:
+        leaders.add(next_code)
+
+    self.blocks = []
+    current = []
+    for i in code:
+      if i.address in leaders and current:
+        self.blocks.append(Block(current))
+        current = []
+      current.append(i)
+    if current:
+      self.blocks.append(Block(current))
+
+    by_address = dict((b.address, b) for b in self.blocks)
+    for n, b in enumerate(self.blocks):
+      last = b.instructions[-1]
+      following = self.blocks[n + 1].address if n + 1 < len(self.blocks) \
+          else None
+      successors = []
+      if last.kind == 'table':
+        successors = tables[last.address]
+      elif last.kind == 'branch':
+        if not last.tail_call:
+          successors = [last.target]
+      elif last.kind == 'return':
+        successors = []
+      elif last.kind == 'cond_branch':
+        successors = [last.target, following]
+      else:
+        successors = [following]
+      b.successors = [by_address[s] for s in successors
+                      if s is not None and s in by_address]
+    self.by_address = by_address
+
+
+class Program(object):
+
+  def __init__(self, objdump, elf, cxxfilt, source_dir):
+    self.source_dir = source_dir
+    self.sources = {}
+    self.functions = {}
+    self.frames = {}
+    self.frame_kinds = {}
+    self.ci_edges = {}
+    self.cycles = {}
+    self.paths = {}
+    self.depths = {}
+    self.disassemble(objdump, elf)
+    self.demangle(cxxfilt)
+
+  def disassemble(self, objdump, elf):
+    output = subprocess.check_output([objdump, '-d', '-l', elf])
+    function = None
+    source = None
+    for line in output.decode('ascii', 'replace').split('\n'):
+      match = FUNCTION.match(line)
+      if match:
+        function = Function(match.group(2), int(match.group(1), 16))
+        self.functions[function.name] = function
+        source = None
+        continue
+      match = SOURCE.match(line)
+      if match:
+        source = (match.group(1), int(match.group(2)))
+        continue
+      match = LINE.match(line)
+      if not match or not function:
+        continue
+      address = int(match.group(1), 16)
+      raw, mnemonic, operands = match.group(2), match.group(3), match.group(4)
+      if mnemonic.startswith('.'):
+        function.add_data(address, raw)
+        continue
+      size = 4 if (' ' in raw or len(raw) == 8) else 2
+      instruction = Instruction(address, size, mnemonic, operands)
+      instruction.source = source
+      function.instructions.append(instruction)
+      function.end = max(function.end, address + size)
+    for f in self.functions.values():
+      f.build()
+
+  def demangle(self, cxxfilt):
+    names = sorted(self.functions.keys())
+    try:
+      process = subprocess.Popen([cxxfilt], stdin=subprocess.PIPE,
+                                 stdout=subprocess.PIPE)
+      output, _ = process.communicate('\n'.join(names).encode('ascii'))
+      demangled = output.decode('ascii').split('\n')
+    except OSError:
+      demangled = names
+    self.pretty = dict(zip(names, demangled))
+
+  def read_call_graphs(self, build_dir):
+    for path in glob.glob(os.path.join(build_dir, '*.ci')):
+      text = open(path).read()
+      for match in CI_NODE.finditer(text):
+        self.frames[match.group(1)] = int(match.group(2))
+        self.frame_kinds[match.group(1)] = match.group(3)
+      for match in CI_EDGE.finditer(text):
+        self.ci_edges.setdefault(match.group(1), set()).add(match.group(2))
+
+  def short_name(self, name):
+    return self.pretty.get(name, name).split('(')[0]
+
+  def source_line(self, source):
+    path, line = source
+    if path not in self.sources:
+      self.sources[path] = []
+      for candidate in [path, os.path.join(self.source_dir, path)]:
+        if os.path.exists(candidate):
+          self.sources[path] = open(candidate).read().split('\n')
+          break
+    lines = self.sources[path]
+    return lines[line - 1] if 0 < line <= len(lines) else ''
+
+  def loop_bound(self, name, back_edges):
+    """Bound of a loop from the source lines of its back edges, the
+    largest one when several loops were merged."""
+    bounds = []
+    unknown = []
+    for instruction in back_edges:
+      if instruction.source is None:
+        continue
+      text = self.source_line(instruction.source)
+      for pattern, bound in LOOP_BOUNDS:
+        if re.search(pattern, text):
+          bounds.append(bound)
+          break
+      else:
+        unknown.append('%s:%d' % instruction.source)
+    if unknown or not bounds:
+      short_name = self.short_name(name)
+      if short_name in LIBRARY_LOOP_BOUNDS and not unknown:
+        return LIBRARY_LOOP_BOUNDS[short_name]
+      error('%s: no bound for the loop at %s' % (
+          short_name, ', '.join(unknown) or 'an address without line '
+          'information (%x)' % back_edges[0].address))
+      return max(bounds) if bounds else 1
+    return max(bounds)
+
+  def region_cost(self, function, blocks, header):
+    """Longest path through blocks, loops collapsed; returns (cycles,
+    calls), calls being a {callee: count} dict."""
+    blocks = sorted(blocks, key=lambda b: b.address)
+    # outermost loops of the region: back edges not nested in another one
+    loops = []
+    for b in blocks:
+      for s in b.successors:
+        if s.address <= b.address and s is not header and \
+              s.address >= blocks[0].address:
+          loops.append((s.address, b.end, b.instructions[-1]))
+    merged = []
+    for start, end, edge in sorted(loops, key=lambda l: (l[0], -l[1])):
+      if merged and start < merged[-1][1]:
+        # a nested loop, counted in the body; back edges to the same
+        # header (continue statements) belong to the same loop
+        edges = merged[-1][2] + [edge] if start == merged[-1][0] \
+            else merged[-1][2]
+        merged[-1] = (merged[-1][0], max(merged[-1][1], end), edges)
+      else:
+        merged.append((start, end, [edge]))
+
+    nodes = []
+    owner = {}
+    for start, end, edges in merged:
+      body = [b for b in blocks if start <= b.address < end]
+      cycles, calls = self.region_cost(function, body, body[0])
+      bound = self.loop_bound(function.name, edges)
+      calls = dict((c, n * bound) for c, n in calls.items())
+      node = (start, cycles * bound, calls, body)
+      nodes.append(node)
+      for b in body:
+        owner[b.address] = node
+    for b in blocks:
+      if b.address not in owner:
+        calls = {}
+        cycles = b.cycles
+        for callee in b.calls:
+          cycles += self.function_cycles(callee)
+          calls[callee] = calls.get(callee, 0) + 1
+        node = (b.address, cycles, calls, [b])
+        nodes.append(node)
+        owner[b.address] = node
+    nodes.sort(key=lambda n: n[0])
+
+    distance = {nodes[0][0]: (0, {})}
+    best = (0, {})
+    for node in nodes:
+      if node[0] not in distance:
+        continue
+      d, path_calls = distance[node[0]]
+      d += node[1]
+      path_calls = dict(path_calls)
+      for c, n in node[2].items():
+        path_calls[c] = path_calls.get(c, 0) + n
+      if d > best[0]:
+        best = (d, path_calls)
+      for b in node[3]:
+        for s in b.successors:
+          target = owner.get(s.address)
+          if target is None or target is node or target[0] <= node[0]:
+            continue
+          if target[0] not in distance or distance[target[0]][0] < d:
+            distance[target[0]] = (d, path_calls)
+    return best
+
+  def function_cycles(self, name):
+    if name in self.cycles:
+      return self.cycles[name]
+    function = self.functions.get(name)
+    if function is None or not function.blocks:
+      warn('%s: no code found, counted as 0 cycles' % name)
+      self.cycles[name] = 0
+      self.paths[name] = {}
+      return 0
+    self.cycles[name] = 0  # breaks recursion
+    cycles, calls = self.region_cost(function, function.blocks, None)
+    for i in function.instructions:
+      if i.kind == 'indirect':
+        warn('%s: indirect call at %x not followed' % (
+            self.short_name(name), i.address))
+    self.cycles[name] = cycles
+    self.paths[name] = calls
+    return cycles
+
+  def callees(self, name):
+    callees = set(self.ci_edges.get(name, set()))
+    function = self.functions.get(name)
+    if function:
+      for b in function.blocks:
+        callees.update(b.calls)
+    return callees
+
+  def frame(self, name):
+    if name in self.frames:
+      if self.frame_kinds[name] == 'dynamic':
+        warn('%s: unbounded dynamic stack frame' % self.short_name(name))
+      return self.frames[name]
+    # functions compiled without -fcallgraph-info (libgcc, startup code):
+    # count the pushed registers and the stack pointer adjustments
+    function = self.functions.get(name)
+    size = 0
+    if function:
+      for i in function.instructions:
+        if i.mnemonic.startswith('push') or i.mnemonic.startswith('stmdb'):
+          size += 4 * len(register_list(i.operands))
+        match = re.match(r'sp, (?:sp, )?#(\d+)', i.operands)
+        if i.mnemonic.startswith('sub') and match:
+          size += int(match.group(1))
+    return size
+
+  def stack_depth(self, name, visiting=()):
+    if name in self.depths:
+      return self.depths[name]
+    if name in visiting:
+      warn('%s: recursion, stack depth not bounded' % self.short_name(name))
+      return 0, []
+    depth, path = 0, []
+    for callee in self.callees(name):
+      d, p = self.stack_depth(callee, visiting + (name,))
+      if d > depth:
+        depth, path = d, p
+    result = (self.frame(name) + depth, [name] + path)
+    self.depths[name] = result
+    return result
+
+  def print_path(self, name, count, indent):
+    print('%s%-*s x%-3d %6d cycles' % (
+        '  ' * indent, 60 - 2 * indent, self.short_name(name), count,
+        count * self.cycles.get(name, 0)))
+    calls = sorted(self.paths.get(name, {}).items(),
+                   key=lambda c: -c[1] * self.cycles.get(c[0], 0))
+    for callee, n in calls:
+      if self.cycles.get(callee, 0):
+        self.print_path(callee, n, indent + 1)
+
+
+def ram_usage(objdump, elf, ram_start, ram_size):
+  output = subprocess.check_output([objdump, '-h', elf]).decode('ascii')
+  lines = output.split('\n')
+  total = 0
+  for n, line in enumerate(lines):
+    match = SECTION.match(line)
+    if not match:
+      continue
+    size, vma = int(match.group(2), 16), int(match.group(3), 16)
+    flags = lines[n + 1] if n + 1 < len(lines) else ''
+    if 'ALLOC' in flags and ram_start <= vma < ram_start + ram_size:
+      total += size
+  return total
+
+
+def main():
+  parser = optparse.OptionParser()
+  parser.add_option('--elf', dest='elf')
+  parser.add_option('--build_dir', dest='build_dir')
+  parser.add_option('--objdump', dest='objdump',
+                    default='arm-none-eabi-objdump')
+  parser.add_option('--cxxfilt', dest='cxxfilt', default='c++filt')
+  parser.add_option('--source_dir', dest='source_dir', default='.')
+  parser.add_option('--f_cpu', dest='f_cpu', default='72000000')
+  parser.add_option('--sample_rate', dest='sample_rate', default='16384')
+  parser.add_option('--ram', dest='ram', type='int', default=20 * 1024)
+  options, _ = parser.parse_args()
+
+  f_cpu = int(options.f_cpu.rstrip('UL'))
+  sample_rate = int(options.sample_rate.rstrip('UL'))
+  tick_budget = f_cpu // sample_rate
+
+  program = Program(options.objdump, options.elf, options.cxxfilt,
+                    options.source_dir)
+  program.read_call_graphs(options.build_dir)
+
+  failed = False
+  print('Worst-case execution time (estimate)')
+  print('')
+  handler_cycles = {}
+  for handler in HANDLERS:
+    cycles = program.function_cycles(handler) + EXCEPTION_CYCLES
+    handler_cycles[handler] = cycles
+    program.print_path(handler, 1, 1)
+    print('')
+
+  tim1 = handler_cycles['TIM1_UP_IRQHandler']
+  load = (tim1 * sample_rate + handler_cycles['SysTick_Handler'] * 1000) * \
+      100.0 / f_cpu
+  print('  TIM1 tick: %d of %d cycles (%d%%), CPU load %.1f%%' % (
+      tim1, tick_budget, tim1 * 100 // tick_budget, load))
+  if tim1 > tick_budget:
+    print('  ERROR: TIM1_UP_IRQHandler exceeds the tick budget at %d Hz' %
+          sample_rate)
+    failed = True
+  print('')
+
+  print('Worst-case stack depth')
+  print('')
+  stack = 0
+  for root in ['main', 'SysTick_Handler', 'TIM1_UP_IRQHandler']:
+    depth, path = program.stack_depth(root)
+    if root != 'main':
+      depth += EXCEPTION_FRAME
+    stack += depth
+    print('  %-24s %5d bytes: %s' % (
+        root, depth, ' > '.join(program.short_name(p) for p in path)))
+  static = ram_usage(options.objdump, options.elf, 0x20000000, options.ram)
+  print('')
+  print('  RAM: %d bytes static + %d bytes stack = %d of %d bytes' % (
+      static, stack, static + stack, options.ram))
+  if static + stack > options.ram:
+    print('  ERROR: RAM exceeded')
+    failed = True
+
+  if warnings:
+    print('')
+    print('Warnings')
+    print('')
+    for w in warnings:
+      print('  ' + w)
+
+  if errors:
+    print('')
+    print('Errors')
+    print('')
+    for e in errors:
+      print('  ERROR: ' + e)
+    failed = True
+
+  sys.exit(1 if failed else 0)
+
+
+if __name__ == '__main__':
+  main()
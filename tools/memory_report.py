@@ -0,0 +1,329 @@
+#!/usr/bin/python
+#
+# Copyright 2015 Matthias Puech.
+#
+# Author: Matthias Puech (matthias.puech@gmail.com)
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+# THE SOFTWARE.
+#
+# See http://creativecommons.org/licenses/MIT/ for more information.
+#
+# -----------------------------------------------------------------------------
+#
+# Flash and RAM budget of the firmware.
+#
+# Sizes per translation unit come from the linker map, sizes per symbol
+# from nm, and the layout of the classes (with their padding holes) from
+# the DWARF debugging information.
+
+from __future__ import print_function
+
+import optparse
+import re
+import subprocess
+import sys
+
+# Classes whose layout is shown even when they have no padding.
+CLASSES = ['batumi::Lfo', 'batumi::Processor', 'batumi::Ui',
+           'batumi::ProcessorParameters', 'stmlib::EventQueue<32>']
+
+FLASH_SECTIONS = ['.text', '.rodata', '.isr_vector', '.ARM', '.init',
+                  '.fini', '.ctors', '.dtors', '.preinit_array',
+                  '.init_array', '.fini_array']
+RAM_SECTIONS = ['.bss', 'COMMON', '.noinit']
+BOTH_SECTIONS = ['.data']  # initial values in flash, copied to RAM
+
+MAP_INPUT = re.compile(r'^ (\.?[\w.$]+|COMMON)?\s+0x([0-9a-f]+)\s+'
+                       r'0x([0-9a-f]+)\s+(\S+)$')
+DIE = re.compile(r'^\s*<(\d+)><([0-9a-f]+)>: Abbrev Number: \d+ \((\w+)\)')
+ATTRIBUTE = re.compile(r'^\s*<[0-9a-f]+>\s+(DW_AT_\w+)\s*:\s*(.*)$')
+
+
+def section_kind(name):
+  for kinds, prefixes in [('flash', FLASH_SECTIONS), ('ram', RAM_SECTIONS),
+                          ('both', BOTH_SECTIONS)]:
+    for prefix in prefixes:
+      if name == prefix or name.startswith(prefix + '.'):
+        return kinds
+  return None
+
+
+def unit_name(path):
+  path = path.split('/')[-1]
+  return re.sub(r'\.o\)?$', '', path)
+
+
+def read_map(path):
+  """Returns {unit: [flash, ram]} from the input sections of a GNU ld
+  map file."""
+  units = {}
+  in_memory_map = False
+  section = None
+  for line in open(path):
+    line = line.rstrip('\n')
+    if line.startswith('Linker script and memory map'):
+      in_memory_map = True
+      continue
+    if not in_memory_map:
+      continue
+    # long section names are alone on their line
+    match = re.match(r'^ (\.[\w.$]+|COMMON)$', line)
+    if match:
+      section = match.group(1)
+      continue
+    match = MAP_INPUT.match(line)
+    if not match or not match.group(4).endswith(('.o', '.o)')):
+      if not line.startswith(' '):
+        section = None
+      continue
+    name = match.group(1) or section
+    section = None
+    if not name or int(match.group(2), 16) == 0:
+      continue  # discarded by --gc-sections
+    kind = section_kind(name)
+    size = int(match.group(3), 16)
+    if not kind or not size:
+      continue
+    usage = units.setdefault(unit_name(match.group(4)), [0, 0])
+    if kind in ['flash', 'both']:
+      usage[0] += size
+    if kind in ['ram', 'both']:
+      usage[1] += size
+  return units
+
+
+def read_symbols(nm, elf):
+  output = subprocess.check_output([nm, '-C', '-S', '--size-sort', elf])
+  symbols = []
+  for line in output.decode('ascii', 'replace').split('\n'):
+    fields = line.split(' ', 3)
+    if len(fields) < 4:
+      continue
+    size, kind, name = int(fields[1], 16), fields[2], fields[3]
+    if kind in 'tTwW':
+      memory = 'flash'
+    elif kind in 'rR':
+      memory = 'flash'
+    elif kind in 'dD':
+      memory = 'flash+ram'
+    elif kind in 'bB':
+      memory = 'ram'
+    else:
+      continue
+    symbols.append((size, memory, kind in 'tTwW', name))
+  return symbols
+
+
+class Dwarf(object):
+
+  def __init__(self, objdump, elf):
+    output = subprocess.check_output([objdump, '--dwarf=info', elf])
+    self.dies = {}
+    stack = []
+    die = None
+    for line in output.decode('ascii', 'replace').split('\n'):
+      match = DIE.match(line)
+      if match:
+        depth = int(match.group(1))
+        die = {'tag': match.group(3), 'children': [], 'parent': None}
+        self.dies[int(match.group(2), 16)] = die
+        del stack[depth:]
+        if stack:
+          die['parent'] = stack[-1]
+          stack[-1]['children'].append(die)
+        stack.append(die)
+        continue
+      match = ATTRIBUTE.match(line)
+      if match and die is not None:
+        die[match.group(1)] = match.group(2).strip()
+
+  @staticmethod
+  def name(die):
+    name = die.get('DW_AT_name')
+    if name and '):' in name:  # indirect string
+      name = name.split('):', 1)[1].strip()
+    return name
+
+  def full_name(self, die):
+    names = []
+    while die is not None:
+      if die['tag'] in ['DW_TAG_namespace', 'DW_TAG_class_type',
+                        'DW_TAG_structure_type']:
+        names.append(self.name(die) or '(anonymous)')
+      die = die['parent']
+    return '::'.join(reversed(names))
+
+  def type_of(self, die):
+    match = re.search(r'<0x([0-9a-f]+)>', die.get('DW_AT_type', ''))
+    return self.dies.get(int(match.group(1), 16)) if match else None
+
+  def size(self, die):
+    if die is None:
+      return 0
+    if 'DW_AT_byte_size' in die:
+      return int(die['DW_AT_byte_size'].split()[0], 0)
+    if die['tag'] in ['DW_TAG_pointer_type', 'DW_TAG_reference_type',
+                      'DW_TAG_rvalue_reference_type', 'DW_TAG_ptr_to_member_type']:
+      return 4
+    if die['tag'] == 'DW_TAG_array_type':
+      count = 1
+      for child in die['children']:
+        if 'DW_AT_count' in child:
+          count *= int(child['DW_AT_count'].split()[0], 0)
+        elif 'DW_AT_upper_bound' in child:
+          count *= int(child['DW_AT_upper_bound'].split()[0], 0) + 1
+      return count * self.size(self.type_of(die))
+    return self.size(self.type_of(die))
+
+  def alignment(self, die):
+    if die is None:
+      return 1
+    if die['tag'] in ['DW_TAG_structure_type', 'DW_TAG_class_type',
+                      'DW_TAG_union_type']:
+      return max([self.alignment(self.type_of(m)) for m in self.members(die)]
+                 + [1])
+    if die['tag'] in ['DW_TAG_base_type', 'DW_TAG_enumeration_type',
+                      'DW_TAG_pointer_type', 'DW_TAG_reference_type']:
+      return min(self.size(die), 8) or 1
+    return self.alignment(self.type_of(die))
+
+  def members(self, die):
+    return [c for c in die['children']
+            if c['tag'] in ['DW_TAG_member', 'DW_TAG_inheritance'] and
+            'DW_AT_data_member_location' in c]
+
+  @staticmethod
+  def offset(member):
+    location = member['DW_AT_data_member_location']
+    match = re.search(r'DW_OP_plus_uconst: (\d+)', location)
+    return int(match.group(1)) if match else int(location.split()[0], 0)
+
+  def classes(self):
+    classes = {}
+    for die in self.dies.values():
+      if die['tag'] in ['DW_TAG_structure_type', 'DW_TAG_class_type'] and \
+            'DW_AT_declaration' not in die and 'DW_AT_byte_size' in die:
+        classes.setdefault(self.full_name(die), die)
+    return classes
+
+  def layout(self, die):
+    """Returns (size, [(offset, size, name)], holes, packed size)."""
+    size = self.size(die)
+    members = []
+    for m in self.members(die):
+      name = self.name(m) or '(base %s)' % self.name(self.type_of(m))
+      members.append((self.offset(m), self.size(self.type_of(m)), name,
+                      self.alignment(self.type_of(m))))
+    members.sort()
+    holes = []
+    end = 0
+    for offset, member_size, name, _ in members:
+      if offset > end:
+        holes.append((end, offset - end, name))
+      end = max(end, offset + member_size)
+    if size > end and members:
+      holes.append((end, size - end, '(tail)'))
+    # best layout: members by decreasing alignment
+    packed = 0
+    for _, member_size, _, align in sorted(members, key=lambda m: -m[3]):
+      packed = (packed + align - 1) // align * align + member_size
+    align = self.alignment(die)
+    packed = (packed + align - 1) // align * align
+    return size, members, holes, packed
+
+
+def main():
+  parser = optparse.OptionParser()
+  parser.add_option('--elf', dest='elf')
+  parser.add_option('--map', dest='map')
+  parser.add_option('--objdump', dest='objdump',
+                    default='arm-none-eabi-objdump')
+  parser.add_option('--nm', dest='nm', default='arm-none-eabi-nm')
+  parser.add_option('--flash', dest='flash', type='int', default=128 * 1024)
+  parser.add_option('--ram', dest='ram', type='int', default=20 * 1024)
+  parser.add_option('--symbols', dest='symbols', type='int', default=25)
+  options, _ = parser.parse_args()
+
+  print('Per translation unit')
+  print('')
+  units = read_map(options.map)
+  total_flash = total_ram = 0
+  print('  %-32s %8s %8s' % ('unit', 'flash', 'ram'))
+  for unit, (flash, ram) in sorted(units.items(), key=lambda u: -u[1][0]):
+    print('  %-32s %8d %8d' % (unit, flash, ram))
+    total_flash += flash
+    total_ram += ram
+  print('  %-32s %8d %8d' % ('total', total_flash, total_ram))
+  print('')
+
+  symbols = read_symbols(options.nm, options.elf)
+  print('Largest objects')
+  print('')
+  objects = [s for s in symbols if not s[2]]
+  for size, memory, _, name in sorted(objects, reverse=True)[:options.symbols]:
+    print('  %-48s %8d %s' % (name[:48], size, memory))
+  tables = [s for s in objects if re.match(r'(batumi::)?(lut|wav)_', s[3])]
+  print('  %-48s %8d flash' % ('(all lut_* and wav_* tables)',
+                                sum(s[0] for s in tables)))
+  print('')
+
+  print('Largest functions')
+  print('')
+  functions = [s for s in symbols if s[2]]
+  for size, _, _, name in sorted(functions,
+                                 reverse=True)[:options.symbols // 2]:
+    print('  %-48s %8d' % (name[:48], size))
+  print('')
+
+  print('Class layouts')
+  print('')
+  dwarf = Dwarf(options.objdump, options.elf)
+  waste = 0
+  for name, die in sorted(dwarf.classes().items()):
+    if not (name.startswith('batumi::') or name in CLASSES):
+      continue
+    size, members, holes, packed = dwarf.layout(die)
+    if not holes and name not in CLASSES:
+      continue
+    print('  %s: %d bytes, %d in padding%s' % (
+        name, size, sum(h[1] for h in holes),
+        ', %d if reordered' % packed if packed < size else ''))
+    for offset, hole, before in holes:
+      print('    %4d: %d byte hole before %s' % (offset, hole, before))
+    waste += size - packed
+  print('')
+
+  print('Budget')
+  print('')
+  failed = False
+  for memory, used, budget in [('flash', total_flash, options.flash),
+                               ('ram', total_ram, options.ram)]:
+    print('  %-5s %6d of %6d bytes (%d%%), %d left' % (
+        memory, used, budget, used * 100 // budget, budget - used))
+    failed = failed or used > budget
+  if waste:
+    print('  reordering the members would save %d bytes, once per instance '
+          'of each class' % waste)
+  print('  (stacks are not included, see the isr_report target)')
+
+  sys.exit(1 if failed else 0)
+
+
+if __name__ == '__main__':
+  main()
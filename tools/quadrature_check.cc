@@ -0,0 +1,154 @@
+// Copyright 2015 Matthias Puech
+//
+// Author: Matthias Puech (matthias.puech@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Drift, accuracy and time per sample of the recursive sine and cosine of
+// the QUAD mode (QuadratureOscillator), measured on the host: the pair
+// follows a phase at constant rates, forwards and backwards, for hours of
+// samples, and is compared to the quarter-wave sine table and to the
+// exact sine.
+
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+
+#include "quadrature_oscillator.h"
+#include "tables.h"
+#include "tools/harness.h"
+
+using namespace batumi;
+
+// up to the fastest rate the oscillator renders (about 120Hz)
+const double kFrequencies[] = { 0.01, 0.1, 1.0, 10.0, 50.0, 120.0 };
+const uint8_t kNumFrequencies = 6;
+const uint32_t kTimingFrames = 10000000;
+const uint8_t kTimingRuns = 5;
+
+QuadratureOscillator oscillator;
+
+struct Drift {
+  // largest error against the table over the first and last tenth of
+  // the run, and over all of it (LSB)
+  int32_t first;
+  int32_t last;
+  int32_t table;
+  // largest error against the exact sine, of the pair and of the table
+  double exact;
+  double table_exact;
+  uint64_t rendered;
+};
+
+void Follow(int32_t increment, uint64_t samples, Drift* d) {
+  *d = Drift();
+  oscillator.Init();
+  uint32_t phase = 0;
+  for (uint64_t n=0; n<samples; n++) {
+    phase += increment;
+    if (!oscillator.Process(phase))
+      continue;
+    d->rendered++;
+    int32_t s = InterpolateSine1022(wav_sine.data, phase);
+    int32_t c = InterpolateSine1022(wav_sine.data, phase + (1UL << 30));
+    int32_t error = std::max(abs(oscillator.sine() - s),
+			     abs(oscillator.cosine() - c));
+    if (n < samples / 10 && error > d->first)
+      d->first = error;
+    if (n >= samples - samples / 10 && error > d->last)
+      d->last = error;
+    if (error > d->table)
+      d->table = error;
+    // sparsely: libm is slower than the whole loop
+    if (n % 61 == 0) {
+      double x = 2.0 * M_PI * phase / 4294967296.0;
+      double exact_s = 32767.0 * sin(x);
+      double exact_c = 32767.0 * cos(x);
+      d->exact = std::max(d->exact, std::max(
+	  fabs(oscillator.sine() - exact_s),
+	  fabs(oscillator.cosine() - exact_c)));
+      d->table_exact = std::max(d->table_exact, std::max(
+	  fabs(s - exact_s), fabs(c - exact_c)));
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  double hours = Option(argc, argv, "hours", 1.0);
+  uint64_t samples = static_cast<uint64_t>(hours * 3600 * SAMPLE_RATE);
+
+  printf("Sample rate %dHz, %.1f hours (%llu samples) per run\n",
+	 SAMPLE_RATE, hours, static_cast<unsigned long long>(samples));
+  printf("errors in LSB of the pair, against the table then exact sine\n");
+  printf("%9s %4s %10s %10s %8s %8s %8s\n", "Hz", "dir", "first 10%",
+	 "last 10%", "table", "exact", "(table)");
+  for (uint8_t f=0; f<kNumFrequencies; f++) {
+    for (int8_t direction=1; direction>=-1; direction-=2) {
+      int32_t increment = direction * static_cast<int32_t>(
+	  kFrequencies[f] / SAMPLE_RATE * 4294967296.0 + 0.5);
+      Drift d;
+      Follow(increment, samples, &d);
+      if (!d.rendered) {
+	printf("%9.2f %4s not rendered\n", kFrequencies[f],
+	       direction > 0 ? "fwd" : "back");
+	continue;
+      }
+      printf("%9.2f %4s %10d %10d %8d %8.2f %8.2f\n", kFrequencies[f],
+	     direction > 0 ? "fwd" : "back", d.first, d.last, d.table,
+	     d.exact, d.table_exact);
+    }
+  }
+
+  // the pair, against the four table reads it replaces in QUAD mode
+  int32_t increment = 10.0 / SAMPLE_RATE * 4294967296.0;
+  double best_oscillator = 1e9, best_table = 1e9;
+  for (uint8_t r=0; r<kTimingRuns; r++) {
+    int32_t sum = 0;
+    uint32_t phase = 0;
+    oscillator.Init();
+    clock_t start = clock();
+    for (uint32_t n=0; n<kTimingFrames; n++) {
+      phase += increment;
+      oscillator.Process(phase);
+      sum += oscillator.sine() - oscillator.cosine();
+    }
+    double t = (clock() - start) * 1e9 / CLOCKS_PER_SEC / kTimingFrames;
+    best_oscillator = std::min(best_oscillator, t);
+
+    phase = 0;
+    start = clock();
+    for (uint32_t n=0; n<kTimingFrames; n++) {
+      phase += increment;
+      for (uint8_t i=0; i<kNumChannels; i++)
+	sum += InterpolateSine1022(wav_sine.data, phase + (i << 30));
+    }
+    t = (clock() - start) * 1e9 / CLOCKS_PER_SEC / kTimingFrames;
+    best_table = std::min(best_table, t);
+    // keeps the rendering from being optimized out
+    if (sum == INT32_MIN)
+      printf("\n");
+  }
+  printf("\nper sample, host: oscillator %.1fns, four table reads %.1fns\n",
+	 best_oscillator, best_table);
+  return 0;
+}
@@ -0,0 +1,103 @@
+// Copyright 2015 Matthias Puech
+//
+// Author: Matthias Puech (matthias.puech@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Accuracy and time per lookup of the quarter-wave sine (the storage of
+// wav_sine with QUARTER_WAVE_TABLES=1), measured on the host: every
+// distinct phase (index and interpolation fraction) read through
+// InterpolateQuarterWave1022 is compared to Interpolate1022 on the full
+// cycle.
+
+#include <cstdio>
+#include <ctime>
+
+#include "stmlib/utils/dsp.h"
+#include "tables.h"
+#include "tools/harness.h"
+
+using namespace batumi;
+using namespace stmlib;
+
+const uint32_t kTimingFrames = 10000000;
+const uint8_t kTimingRuns = 5;
+
+// both storages, whatever the build
+constexpr Table<int16_t, 257> quarter_sine = MakeQuarterSine<257>();
+constexpr Table<int16_t, 1025> full_sine = MakeSine<1025>();
+
+int main(int argc, char** argv) {
+  uint32_t step = Option(argc, argv, "step", 1);
+
+  printf("%llu phases, against the full cycle\n",
+	 (1ULL << 26) / step);
+  uint64_t mismatches = 0;
+  int32_t error = 0;
+  // the 6 lowest bits of the phase are not read
+  for (uint64_t p=0; p<(1ULL << 32); p+=step << 6) {
+    uint32_t phase = p;
+    int32_t d = InterpolateQuarterWave1022(quarter_sine.data, phase) -
+      Interpolate1022(full_sine.data, phase);
+    if (d) {
+      mismatches++;
+      error = std::max(error, abs(d));
+    }
+  }
+  printf("mismatches %llu, max %d LSB\n",
+	 static_cast<unsigned long long>(mismatches), error);
+
+  // four channels a quarter cycle apart, as the sines of the QUAD mode
+  uint32_t increment = 10.0 / SAMPLE_RATE * 4294967296.0;
+  double best_quarter = 1e9, best_full = 1e9;
+  for (uint8_t r=0; r<kTimingRuns; r++) {
+    int32_t sum = 0;
+    uint32_t phase = 0;
+    clock_t start = clock();
+    for (uint32_t n=0; n<kTimingFrames; n++) {
+      phase += increment;
+      for (uint8_t i=0; i<kNumChannels; i++)
+	sum += InterpolateQuarterWave1022(quarter_sine.data, phase + (i << 30));
+    }
+    double t = (clock() - start) * 1e9 / CLOCKS_PER_SEC /
+      (kTimingFrames * kNumChannels);
+    best_quarter = std::min(best_quarter, t);
+
+    phase = 0;
+    start = clock();
+    for (uint32_t n=0; n<kTimingFrames; n++) {
+      phase += increment;
+      for (uint8_t i=0; i<kNumChannels; i++)
+	sum += Interpolate1022(full_sine.data, phase + (i << 30));
+    }
+    t = (clock() - start) * 1e9 / CLOCKS_PER_SEC /
+      (kTimingFrames * kNumChannels);
+    best_full = std::min(best_full, t);
+    // keeps the lookups from being optimized out
+    if (sum == INT32_MIN)
+      printf("\n");
+  }
+  printf("\nper lookup, host: quarter wave %.2fns, full cycle %.2fns\n",
+	 best_quarter, best_full);
+  return 0;
+}
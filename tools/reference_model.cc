@@ -0,0 +1,157 @@
+// Copyright 2015 Matthias Puech
+//
+// Author: Matthias Puech (matthias.puech@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Accuracy of the LFOs against a double-precision model, measured on the
+// host. For each sample rate, divider and frequency: error of the
+// frequency and drift of the phase against the exact pitch, and error of
+// each shape against the exact shape at the phase of the LFO (fixed-point
+// interpolation and slow-rate rendering). The shapes other than the sine
+// are band-limited above 1Hz, on purpose: see alias_report for them.
+
+#include <cstdio>
+
+#include "lfo.h"
+#include "tools/harness.h"
+
+using namespace batumi;
+
+const uint32_t kSampleRates[] = { 16384, 32768 };
+const uint8_t kNumSampleRates = 2;
+const uint16_t kDividers[] = { 1, 3, 16 };
+const uint8_t kNumDividers = 3;
+const double kFrequencies[] = { 0.02, 0.2, 0.8, 5.0, 50.0, 500.0 };
+const uint8_t kNumFrequencies = 6;
+// samples per run
+const uint32_t kLength = 1 << 19;
+// below this, the shapes are rendered without band-limiting
+const double kNaiveFrequency = 1.0;
+
+const char* kShapeNames[kNumLfoShapes] = {
+  "sine", "trapezoid", "ramp", "saw", "triangle"
+};
+
+inline int16_t FrequencyToPitch(double frequency) {
+  return floor((69.0 + 12.0 * log2(frequency / 440.0)) * 128.0 + 0.5);
+}
+
+inline double PitchToFrequency(int16_t pitch) {
+  return 440.0 * pow(2.0, (pitch / 128.0 - 69.0) / 12.0);
+}
+
+// the shapes as specified, phase in cycles, at full level
+double Shape(LfoShape shape, double phase) {
+  double triangle = phase < 0.5 ? -1.0 + 4.0 * phase : 3.0 - 4.0 * phase;
+  double x = 0.0;
+  switch (shape) {
+  case SHAPE_SINE:
+    x = -sin(2.0 * M_PI * phase);
+    break;
+  case SHAPE_TRIANGLE:
+    x = triangle;
+    break;
+  case SHAPE_TRAPEZOID:
+    x = 2.0 * triangle;
+    CONSTRAIN(x, -1.0, 1.0);
+    break;
+  case SHAPE_RAMP:
+    x = -1.0 + 2.0 * phase;
+    break;
+  case SHAPE_SAW:
+    x = 1.0 - 2.0 * phase;
+    break;
+  }
+  return x * 32767.0 * UINT16_MAX / 65536.0;
+}
+
+int main() {
+  printf("Tables for %dHz, %d samples per run\n", SAMPLE_RATE, kLength);
+  printf("Frequency error (cents), phase drift at the end of the run "
+	 "(degrees), shape error rms/max (LSB)\n");
+  printf("%6s %3s %8s %8s %8s", "rate", "div", "f0 (Hz)", "cents",
+	 "drift");
+  for (uint8_t s=0; s<kNumLfoShapes; s++)
+    printf(" %15s", kShapeNames[s]);
+  printf("\n");
+
+  Statistics worst[kNumLfoShapes];
+  for (uint8_t r=0; r<kNumSampleRates; r++) {
+    for (uint8_t d=0; d<kNumDividers; d++) {
+      for (uint8_t f=0; f<kNumFrequencies; f++) {
+	int16_t pitch = FrequencyToPitch(kFrequencies[f]);
+	double frequency = PitchToFrequency(pitch) / kDividers[d];
+	double increment = frequency / kSampleRates[r];
+
+	Lfo lfo;
+	lfo.Init();
+	lfo.set_sample_rate(kSampleRates[r]);
+	lfo.set_pitch(pitch);
+	lfo.set_divider(kDividers[d]);
+	lfo.Step();
+
+	// the phase is unwrapped to measure the drift
+	Statistics error[kNumLfoShapes];
+	uint32_t previous_phase = lfo.phase();
+	uint64_t advance = 0;
+	for (uint32_t n=1; n<kLength; n++) {
+	  lfo.Step();
+	  uint32_t phase = lfo.phase();
+	  advance += static_cast<uint32_t>(phase - previous_phase);
+	  previous_phase = phase;
+	  double x = phase / 4294967296.0;
+	  for (uint8_t s=0; s<kNumLfoShapes; s++) {
+	    LfoShape shape = static_cast<LfoShape>(s);
+	    int16_t y = lfo.ComputeSampleShape(shape);
+	    if (s == SHAPE_SINE || frequency < kNaiveFrequency)
+	      error[s].Add(y - Shape(shape, x));
+	  }
+	}
+	double drift = advance / 4294967296.0 - (kLength - 1) * increment;
+	double cents = 1200.0 * log2(
+	    (increment + drift / (kLength - 1)) / increment);
+
+	printf("%6d %3d %8.3f %8.4f %8.1f", kSampleRates[r], kDividers[d],
+	       frequency, cents, drift * 360.0);
+	for (uint8_t s=0; s<kNumLfoShapes; s++) {
+	  if (!error[s].count()) {
+	    printf(" %15s", "-");
+	    continue;
+	  }
+	  double rms = sqrt(error[s].deviation() * error[s].deviation() +
+			    error[s].mean() * error[s].mean());
+	  double max = std::max(-error[s].min(), error[s].max());
+	  printf(" %7.2f/%7.1f", rms, max);
+	  worst[s].Add(max);
+	}
+	printf("\n");
+      }
+    }
+  }
+  printf("%28s", "worst");
+  for (uint8_t s=0; s<kNumLfoShapes; s++)
+    printf(" %15.1f", worst[s].max());
+  printf("\n");
+  return 0;
+}
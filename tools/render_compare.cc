@@ -0,0 +1,153 @@
+// Copyright 2015 Matthias Puech
+//
+// Author: Matthias Puech (matthias.puech@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Slow-rate rendering of the LFO shapes, measured on the host. Random
+// settings (pitch, divider, level, hold, direction, resets) change over
+// the frames, and each shape as rendered is compared to the shape
+// computed at the phase of the LFO; then the time per frame is measured
+// on fixed settings, below and above the 1Hz threshold of the rendering.
+
+#include <cstdio>
+#include <ctime>
+
+#include "lfo.h"
+#include "tools/harness.h"
+
+using namespace batumi;
+
+const uint32_t kNumFrames = 400000;
+// frames between changes of the settings
+const uint32_t kSettingsPeriod = 4096;
+// frequencies of the timing runs
+const double kTimingFrequencies[] = { 0.1, 0.9, 5.0, 200.0 };
+const uint8_t kNumTimingFrequencies = 4;
+const uint8_t kTimingRuns = 5;
+
+const char* kShapeNames[kNumLfoShapes] = {
+  "sine", "trapezoid", "ramp", "saw", "triangle"
+};
+
+inline int16_t FrequencyToPitch(double frequency) {
+  return floor((69.0 + 12.0 * log2(frequency / 440.0)) * 128.0 + 0.5);
+}
+
+int16_t Exact(Lfo* lfo, LfoShape shape) {
+  uint32_t phase = lfo->phase();
+  switch (shape) {
+  case SHAPE_SINE: return lfo->ComputeSampleSine(phase);
+  case SHAPE_TRAPEZOID: return lfo->ComputeSampleTrapezoid(phase);
+  case SHAPE_RAMP: return lfo->ComputeSampleRamp(phase);
+  case SHAPE_SAW: return lfo->ComputeSampleSaw(phase);
+  case SHAPE_TRIANGLE: return lfo->ComputeSampleTriangle(phase);
+  }
+  return 0;
+}
+
+void Compare(Random* random) {
+  const uint16_t dividers[] = { 1, 2, 3, 8 };
+  Lfo lfo;
+  lfo.Init();
+  lfo.set_sample_rate(SAMPLE_RATE);
+
+  Statistics error[kNumLfoShapes];
+  uint32_t compared = 0;
+  uint32_t differ = 0;
+  for (uint32_t n=0; n<kNumFrames; n++) {
+    if (n % kSettingsPeriod == 0) {
+      // mostly below 1Hz, where the shapes are rendered
+      double frequency = 0.01 * pow(2.0, random->Uniform() * 9.0);
+      lfo.set_pitch(FrequencyToPitch(frequency));
+      lfo.set_divider(dividers[random->Next() % 4]);
+      lfo.set_level(random->Next() % 4 ? UINT16_MAX : random->Next());
+      lfo.set_direction(random->Next() % 4);
+      lfo.set_hold(random->Next() % 8 == 0);
+    }
+    if (random->Next() % 20000 == 0)
+      lfo.Reset(random->Next() % 32);
+    lfo.Step();
+
+    bool frame_differs = false;
+    for (uint8_t s=0; s<kNumLfoShapes; s++) {
+      LfoShape shape = static_cast<LfoShape>(s);
+      int16_t rendered = lfo.ComputeSampleShape(shape);
+      if (lfo.resetting())
+	continue;
+      int16_t exact = Exact(&lfo, shape);
+      error[s].Add(rendered - exact);
+      frame_differs |= rendered != exact;
+    }
+    if (!lfo.resetting()) {
+      compared++;
+      differ += frame_differs;
+    }
+  }
+
+  printf("%d frames, %d compared outside the reset steps, %.1f%% of "
+	 "them rendered off the exact shape\n", kNumFrames, compared,
+	 100.0 * differ / compared);
+  printf("%-10s %8s %8s\n", "shape", "rms", "max");
+  for (uint8_t s=0; s<kNumLfoShapes; s++) {
+    double rms = sqrt(error[s].deviation() * error[s].deviation() +
+		      error[s].mean() * error[s].mean());
+    printf("%-10s %8.2f %8.0f\n", kShapeNames[s], rms,
+	   std::max(-error[s].min(), error[s].max()));
+  }
+  printf("\n");
+}
+
+// one shape per frame, as the processor renders it
+void Time() {
+  printf("%-10s %12s\n", "f0 (Hz)", "ns/frame");
+  for (uint8_t f=0; f<kNumTimingFrequencies; f++) {
+    double best = 1e9;
+    for (uint8_t run=0; run<kTimingRuns; run++) {
+      Lfo lfo;
+      lfo.Init();
+      lfo.set_sample_rate(SAMPLE_RATE);
+      lfo.set_pitch(FrequencyToPitch(kTimingFrequencies[f]));
+      int32_t sum = 0;
+      clock_t start = clock();
+      for (uint32_t n=0; n<kNumFrames; n++) {
+	lfo.Step();
+	sum += lfo.ComputeSampleShape(SHAPE_TRIANGLE);
+      }
+      double t = (clock() - start) * 1e9 / CLOCKS_PER_SEC / kNumFrames;
+      // keeps the rendering from being optimized out
+      if (sum == INT32_MIN)
+	printf("\n");
+      if (t < best)
+	best = t;
+    }
+    printf("%-10.1f %12.1f\n", kTimingFrequencies[f], best);
+  }
+}
+
+int main(int argc, char** argv) {
+  Random random(Option(argc, argv, "seed", 1));
+  Compare(&random);
+  Time();
+  return 0;
+}
@@ -0,0 +1,469 @@
+// Copyright 2015 Matthias Puech
+//
+// Author: Matthias Puech (matthias.puech@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Discrete-event model of the three execution contexts of batumi.cc, in
+// CPU cycles: the TIM1 tick (Processor::Process, highest priority), the
+// SysTick handler (Ui::Poll, every millisecond, preempted by TIM1) and
+// the main loop (Ui::DoEvents then __WFI, preempted by both). The cost of
+// each context is an option; the model measures what the UI gets out of
+// the time left:
+// - latency from a pot move to the parameters read by the tick
+// - occupancy and overflow of the 32-entry event queue
+// - delay of the SysTick handler by the tick preempting it
+// and sweeps each cost to find where these break.
+
+#include <cstdio>
+
+#include "drivers/adc.h"
+#include "processor.h"
+#include "tools/harness.h"
+
+using namespace batumi;
+
+// as in ui.cc
+const int32_t kPotMoveThreshold = 1 << (16 - 10);
+// stacking on exception entry, and unstacking on return
+const uint32_t kExceptionOverhead = 12 + 10;
+// stmlib::EventQueue<32>: its ring buffer overwrites, so the 32nd unread
+// event makes the queue look empty; it and the 31 before it are lost
+const uint32_t kQueueSize = 32;
+// pot moves: all four at once, the next ones when the filter has settled
+const uint32_t kMoveInterval = 300;  // ms
+
+enum Context {
+  CONTEXT_TICK,
+  CONTEXT_SYSTICK,
+  CONTEXT_MAIN,
+  CONTEXT_LAST
+};
+
+// cycles of each handler, overhead of the exception excluded
+struct Costs {
+  uint32_t tick;
+  // Ui::Poll: debouncing, pot filters, LEDs and parameters
+  uint32_t poll;
+  // Ui::DoEvents, per event pulled
+  uint32_t event;
+  // Ui::DoEvents with the queue empty, and the wake-up from __WFI
+  uint32_t loop;
+};
+
+struct Report {
+  // ticks and milliseconds lost: a new interrupt while one was pending
+  uint32_t lost_ticks;
+  uint32_t lost_polls;
+  // longest tick, from its timer update to its end (cycles)
+  uint64_t tick_response;
+  // from the SysTick to the end of Ui::Poll, and the most of it spent
+  // in the tick (cycles)
+  Statistics poll_response;
+  uint64_t poll_preemption;
+  uint32_t max_queued;
+  uint32_t overflows;
+  uint32_t lost_events;
+  // from an event in the queue to its handling (cycles)
+  uint64_t event_wait;
+  // from a pot move to the first tick with a new coarse value, and to
+  // the first one with 90% of the move (ms)
+  Statistics first_response;
+  Statistics response_90;
+  // share of the CPU per context
+  double load[CONTEXT_LAST];
+};
+
+class Simulator {
+ public:
+  Simulator(const Costs& costs, uint32_t sample_rate, uint32_t seed)
+    : costs_(costs),
+      random_(seed),
+      tick_period_(F_CPU / sample_rate),
+      poll_period_(F_CPU / 1000) { }
+
+  void Run(double seconds, Report* report) {
+    *report = Report();
+    report_ = report;
+
+    uint64_t end = static_cast<uint64_t>(seconds * F_CPU);
+    uint64_t busy[CONTEXT_LAST] = { };
+    for (uint8_t c=0; c<CONTEXT_LAST; c++) {
+      queued_[c] = 0;
+      left_[c] = 0;
+    }
+    sleeping_ = false;
+    handling_ = false;
+    ticks_ = 0;
+    queue_read_ = queue_write_ = 0;
+    for (uint8_t i=0; i<kNumChannels; i++) {
+      pot_[i] = adc_pot_[i] = pot_filtered_[i] = pot_value_[i] =
+	pot_coarse_[i] = coarse_[i] = 32768;
+      move_pending_[i] = 0;
+    }
+
+    uint64_t next_tick = 0;
+    uint64_t next_poll = poll_period_ / 2;
+    uint64_t next_move = kMoveInterval * poll_period_;
+    now_ = 0;
+    while (now_ < end) {
+      uint64_t next = std::min(next_tick, std::min(next_poll, next_move));
+      Context c = Active();
+      if (c == CONTEXT_LAST) {
+	now_ = next;
+      } else {
+	uint64_t run = std::min<uint64_t>(left_[c], next - now_);
+	now_ += run;
+	left_[c] -= run;
+	busy[c] += run;
+	if (!left_[c])
+	  Complete(c);
+      }
+      if (now_ == next_tick) {
+	Release(CONTEXT_TICK, &report_->lost_ticks);
+	next_tick += tick_period_;
+      }
+      if (now_ == next_poll) {
+	Release(CONTEXT_SYSTICK, &report_->lost_polls);
+	next_poll += poll_period_;
+      }
+      if (now_ == next_move) {
+	Move();
+	next_move += kMoveInterval * poll_period_ +
+	  random_.Next() % poll_period_;
+      }
+    }
+    for (uint8_t c=0; c<CONTEXT_LAST; c++)
+      report_->load[c] = static_cast<double>(busy[c]) / now_;
+  }
+
+ private:
+  void Release(Context c, uint32_t* lost) {
+    if (queued_[c]) {
+      ++*lost;
+    } else {
+      queued_[c] = 1;
+      release_[c] = now_;
+    }
+  }
+
+  // the context running: the highest priority one with an instance
+  // started or pending; the main loop runs when none has
+  Context Active() {
+    for (uint8_t c=0; c<CONTEXT_MAIN; c++) {
+      if (left_[c])
+	return static_cast<Context>(c);
+      if (queued_[c]) {
+	Start(static_cast<Context>(c));
+	return static_cast<Context>(c);
+      }
+    }
+    if (sleeping_)
+      return CONTEXT_LAST;
+    if (!left_[CONTEXT_MAIN])
+      Start(CONTEXT_MAIN);
+    return CONTEXT_MAIN;
+  }
+
+  void Start(Context c) {
+    switch (c) {
+    case CONTEXT_TICK:
+      queued_[c] = 0;
+      started_[c] = release_[c];
+      left_[c] = costs_.tick + kExceptionOverhead;
+      // a mux position read every other tick: pot i with CV i
+      if (ticks_ % 2 && (ticks_ / 2) % kNumAdcChannels < kNumChannels) {
+	uint8_t i = (ticks_ / 2) % kNumAdcChannels;
+	adc_pot_[i] = pot_[i];
+      }
+      ticks_++;
+      Tick();
+      break;
+    case CONTEXT_SYSTICK:
+      queued_[c] = 0;
+      started_[c] = release_[c];
+      left_[c] = costs_.poll + kExceptionOverhead;
+      preempted_cycles_ = 0;
+      Poll();
+      break;
+    case CONTEXT_MAIN:
+      handling_ = Available();
+      if (handling_) {
+	left_[c] = costs_.event;
+	uint64_t wait = now_ - queue_[queue_read_].time;
+	if (wait > report_->event_wait)
+	  report_->event_wait = wait;
+      } else {
+	left_[c] = costs_.loop;
+      }
+      break;
+    default:
+      break;
+    }
+  }
+
+  void Complete(Context c) {
+    switch (c) {
+    case CONTEXT_TICK:
+      if (now_ - started_[c] > report_->tick_response)
+	report_->tick_response = now_ - started_[c];
+      if (left_[CONTEXT_SYSTICK])
+	preempted_cycles_ += costs_.tick + kExceptionOverhead;
+      sleeping_ = false;
+      break;
+    case CONTEXT_SYSTICK:
+      report_->poll_response.Add(now_ - started_[c]);
+      if (preempted_cycles_ > report_->poll_preemption)
+	report_->poll_preemption = preempted_cycles_;
+      // Ui::UpdateParameters, at the end of Ui::Poll
+      for (uint8_t i=0; i<kNumChannels; i++)
+	coarse_[i] = pot_coarse_[i];
+      sleeping_ = false;
+      break;
+    case CONTEXT_MAIN:
+      if (handling_) {
+	// Ui::OnPotChanged, in UI_MODE_NORMAL
+	const QueuedEvent& e = queue_[queue_read_];
+	pot_coarse_[e.pot] = e.value;
+	queue_read_ = (queue_read_ + 1) % kQueueSize;
+      } else {
+	sleeping_ = true;
+      }
+      break;
+    default:
+      break;
+    }
+  }
+
+  // the filter and events of Ui::Poll, at its start; the parameters are
+  // updated at its end
+  void Poll() {
+    for (uint8_t i=0; i<kNumChannels; i++) {
+      int32_t value = (31 * pot_filtered_[i] + adc_pot_[i]) >> 5;
+      pot_filtered_[i] = value;
+      if (value >= pot_value_[i] + kPotMoveThreshold ||
+	  value <= pot_value_[i] - kPotMoveThreshold) {
+	AddEvent(i, value);
+	pot_value_[i] = value;
+      }
+    }
+  }
+
+  void AddEvent(uint8_t pot, int32_t value) {
+    uint32_t available = Available();
+    if (available == kQueueSize - 1) {
+      report_->overflows++;
+      report_->lost_events += available + 1;
+    }
+    queue_[queue_write_].pot = pot;
+    queue_[queue_write_].value = value;
+    queue_[queue_write_].time = now_;
+    queue_write_ = (queue_write_ + 1) % kQueueSize;
+    if (Available() > report_->max_queued)
+      report_->max_queued = Available();
+  }
+
+  inline uint32_t Available() const {
+    return (queue_write_ - queue_read_) % kQueueSize;
+  }
+
+  // the parameters read by Processor::Process
+  void Tick() {
+    for (uint8_t i=0; i<kNumChannels; i++) {
+      if (!move_pending_[i])
+	continue;
+      int32_t travel = pot_[i] - move_from_[i];
+      int32_t done = coarse_[i] - move_from_[i];
+      double ms = static_cast<double>(now_ - move_time_[i]) * 1000.0 / F_CPU;
+      if (move_pending_[i] == 2 && done) {
+	report_->first_response.Add(ms);
+	move_pending_[i] = 1;
+      }
+      if (10 * static_cast<int64_t>(done) * (travel > 0 ? 1 : -1) >=
+	  9 * static_cast<int64_t>(abs(travel))) {
+	report_->response_90.Add(ms);
+	move_pending_[i] = 0;
+      }
+    }
+  }
+
+  // each pot to the other half of its travel
+  void Move() {
+    for (uint8_t i=0; i<kNumChannels; i++) {
+      move_from_[i] = coarse_[i];
+      int32_t to = random_.Next() % 32768;
+      pot_[i] = pot_[i] < 32768 ? 32768 + to : to;
+      move_time_[i] = now_;
+      move_pending_[i] = 2;
+    }
+  }
+
+  struct QueuedEvent {
+    uint8_t pot;
+    int32_t value;
+    uint64_t time;
+  };
+
+  Costs costs_;
+  Random random_;
+  uint64_t tick_period_;
+  uint64_t poll_period_;
+  Report* report_;
+
+  uint64_t now_;
+  uint8_t queued_[CONTEXT_LAST];
+  uint64_t release_[CONTEXT_LAST];
+  uint64_t started_[CONTEXT_LAST];
+  uint64_t left_[CONTEXT_LAST];
+  bool sleeping_;
+  // the main loop is in Ui::OnPotChanged, otherwise on its way to __WFI
+  bool handling_;
+  uint64_t preempted_cycles_;
+  uint32_t ticks_;
+
+  QueuedEvent queue_[kQueueSize];
+  uint32_t queue_read_;
+  uint32_t queue_write_;
+
+  // the pot, as last read by the ADC, and the state of the Ui
+  int32_t pot_[kNumChannels];
+  int32_t adc_pot_[kNumChannels];
+  int32_t pot_filtered_[kNumChannels];
+  int32_t pot_value_[kNumChannels];
+  int32_t pot_coarse_[kNumChannels];
+  // ProcessorParameters::coarse
+  int32_t coarse_[kNumChannels];
+
+  // 2 until the first response, 1 until 90% of the travel
+  uint8_t move_pending_[kNumChannels];
+  int32_t move_from_[kNumChannels];
+  uint64_t move_time_[kNumChannels];
+};
+
+void Print(const Report& r, uint32_t sample_rate) {
+  double us = 1e6 / F_CPU;
+  printf("load: tick %.1f%%, SysTick %.1f%%, main loop %.1f%%\n",
+	 100 * r.load[CONTEXT_TICK], 100 * r.load[CONTEXT_SYSTICK],
+	 100 * r.load[CONTEXT_MAIN]);
+  printf("tick: %u lost, longest %.1fus of %.1fus\n", r.lost_ticks,
+	 r.tick_response * us, 1e6 / sample_rate);
+  if (r.poll_response.count())
+    printf("Ui::Poll: %u lost, from SysTick to end mean %.1fus max %.1fus, "
+	   "preempted up to %.1fus\n", r.lost_polls,
+	   r.poll_response.mean() * us, r.poll_response.max() * us,
+	   r.poll_preemption * us);
+  else
+    printf("Ui::Poll: never completes\n");
+  printf("event queue: up to %u of %u, %u overflows (%u events lost), "
+	 "wait up to %.1fus\n", r.max_queued, kQueueSize, r.overflows,
+	 r.lost_events, r.event_wait * us);
+  if (r.first_response.count() && r.response_90.count())
+    printf("pot to parameter: first change median %.2fms max %.2fms, "
+	   "90%% median %.1fms max %.1fms\n",
+	   r.first_response.Percentile(0.5), r.first_response.max(),
+	   r.response_90.Percentile(0.5), r.response_90.max());
+  else
+    printf("pot to parameter: no response\n");
+}
+
+Report Simulate(const Costs& costs, uint32_t sample_rate,
+		double seconds) {
+  Simulator simulator(costs, sample_rate, 1);
+  Report r;
+  simulator.Run(seconds, &r);
+  return r;
+}
+
+// the model over a range of one cost, up to the first that breaks it;
+// then the exact cost where it breaks, by bisection, or 0
+uint32_t Sweep(const char* name, Costs costs, uint32_t Costs::*cost,
+	       uint32_t from, uint32_t to, uint32_t step,
+	       bool (*breaks)(const Report&),
+	       uint32_t sample_rate, double seconds) {
+  printf("\n%-8s %8s %10s %10s %8s %8s %8s %8s\n", name, "irq %",
+	 "poll us", "pot ms", "queued", "lost ev", "lost ms", "lost tk");
+  uint32_t good = from;
+  for (uint32_t c=from; c<=to; c+=step) {
+    costs.*cost = c;
+    Report r = Simulate(costs, sample_rate, seconds);
+    double us = 1e6 / F_CPU;
+    printf("%-8u %8.1f %10.1f %10.2f %8u %8u %8u %8u\n", c,
+	   100 * (r.load[CONTEXT_TICK] + r.load[CONTEXT_SYSTICK]),
+	   r.poll_response.count() ? r.poll_response.max() * us : -1.0,
+	   r.first_response.count() ? r.first_response.max() : -1.0,
+	   r.max_queued, r.lost_events, r.lost_polls, r.lost_ticks);
+    if (!breaks(r)) {
+      good = c;
+      continue;
+    }
+    uint32_t bad = c;
+    while (bad - good > 1) {
+      costs.*cost = (good + bad) / 2;
+      if (breaks(Simulate(costs, sample_rate, seconds)))
+	bad = costs.*cost;
+      else
+	good = costs.*cost;
+    }
+    return bad;
+  }
+  return 0;
+}
+
+bool LosesTicks(const Report& r) { return r.lost_ticks; }
+bool LosesPolls(const Report& r) { return r.lost_polls; }
+bool LosesEvents(const Report& r) { return r.lost_events; }
+
+int main(int argc, char** argv) {
+  uint32_t sample_rate = Option(argc, argv, "sample_rate", SAMPLE_RATE);
+  double seconds = Option(argc, argv, "seconds", 10.0);
+  uint32_t tick_period = F_CPU / sample_rate;
+  Costs costs;
+  costs.tick = Option(argc, argv, "tick", tick_period / 2);
+  costs.poll = Option(argc, argv, "poll", 2000);
+  costs.event = Option(argc, argv, "event", 100);
+  costs.loop = Option(argc, argv, "loop", 50);
+
+  printf("%dHz tick (%d cycles), costs in cycles: tick %u, Ui::Poll %u, "
+	 "event %u, loop %u\n", sample_rate, tick_period, costs.tick,
+	 costs.poll, costs.event, costs.loop);
+  printf("%.0fs simulated, the four pots moved every %dms\n\n", seconds,
+	 kMoveInterval);
+  Simulator simulator(costs, sample_rate, Option(argc, argv, "seed", 1));
+  Report report;
+  simulator.Run(seconds, &report);
+  Print(report, sample_rate);
+
+  // how much each context can take before the model breaks
+  uint32_t limit;
+  limit = Sweep("tick", costs, &Costs::tick, tick_period / 10,
+		tick_period + tick_period / 10, tick_period / 10,
+		LosesTicks, sample_rate, seconds);
+  printf("ticks lost from %u cycles per tick\n", limit);
+  limit = Sweep("poll", costs, &Costs::poll, 5000, 80000, 5000,
+		LosesPolls, sample_rate, seconds);
+  printf("milliseconds lost from %u cycles per Ui::Poll\n", limit);
+  limit = Sweep("event", costs, &Costs::event, 1000, 40000, 1000,
+		LosesEvents, sample_rate, seconds);
+  printf("events lost from %u cycles per event\n", limit);
+  return 0;
+}
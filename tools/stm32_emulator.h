@@ -0,0 +1,1494 @@
+// Copyright 2015 Matthias Puech
+//
+// Author: Matthias Puech (matthias.puech@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// An STM32F103 running a firmware image, instruction by instruction on
+// Unicorn 2 (Cortex-M3, Thumb-2). Only what the firmware images touch is
+// modelled: the RCC and flash interface flags, GPIOA-C, TIM1-4 with their
+// update interrupts and compare registers, ADC1/ADC2 (single, scan,
+// continuous and dual regular simultaneous modes) with DMA1 channel 1,
+// SysTick, the NVIC and the DWT cycle counter. The core clock is taken
+// as F_CPU whatever the RCC is set to, and the analog inputs are set per
+// ADC channel and mux address (PA3-5), as wired on the board.
+//
+// The cycle counts are estimates from the Cortex-M3 timings with the 2
+// flash wait states of 72MHz:
+// - 1 per instruction, 2 per load or store (without the pipelining of
+//   neighbouring loads), 1 + N per load/store multiple of N registers
+// - 2 for MLA/MLS, 5 for the long multiplies (their worst case)
+// - 2 to 12 for UDIV/SDIV: 2 when the quotient is 0, else 2 plus one
+//   per 3 bits of quotient, from the operands
+// - 4 more on a taken branch: 2 to refill the pipeline and 2 wait states
+//   to fetch the target; sequential fetches are hidden by the prefetch
+//   buffer
+// - 2 wait states on each data read from flash (tables, literals)
+// - 12 to enter an exception and 10 to return, without tail-chaining
+
+#ifndef BATUMI_TOOLS_STM32_EMULATOR_H_
+#define BATUMI_TOOLS_STM32_EMULATOR_H_
+
+#include <elf.h>
+#include <stdint.h>
+#include <unicorn/unicorn.h>
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace batumi {
+
+const uint32_t kFlashBase = 0x08000000;
+const uint32_t kFlashSize = 0x20000;
+const uint32_t kFlashPageSize = 0x400;
+const uint32_t kRamBase = 0x20000000;
+const uint32_t kRamSize = 0x5000;
+const uint32_t kSystemMemoryBase = 0x1ffff000;
+const uint32_t kSystemMemorySize = 0x1000;
+const uint32_t kPeripheralBase = 0x40000000;
+const uint32_t kPeripheralSize = 0x30000;
+const uint32_t kPpbBase = 0xe0000000;
+const uint32_t kPpbSize = 0x100000;
+const uint32_t kBitBandOffset = 0x02000000;
+
+// the handlers return there instead of to an EXC_RETURN value
+const uint32_t kReturnAddress = kSystemMemoryBase;
+
+const uint32_t kFlashWaitStates = 2;
+const uint32_t kBranchCycles = 2 + kFlashWaitStates;
+const uint32_t kEntryCycles = 12;
+const uint32_t kExitCycles = 10;
+
+enum Exception {
+  EXCEPTION_SYSTICK = 15,
+  EXCEPTION_DMA1_CHANNEL1 = 16 + 11,
+  EXCEPTION_ADC1_2 = 16 + 18,
+  EXCEPTION_TIM1_UP = 16 + 25,
+  EXCEPTION_TIM1_CC = 16 + 27,
+  EXCEPTION_TIM2 = 16 + 28,
+  EXCEPTION_TIM3 = 16 + 29,
+  EXCEPTION_TIM4 = 16 + 30,
+  EXCEPTION_LAST = 16 + 68
+};
+
+// TIM1, TIM2, TIM3, TIM4
+const uint32_t kTimerBases[] = {
+  0x40012c00, 0x40000000, 0x40000400, 0x40000800
+};
+const uint8_t kNumTimers = 4;
+const uint32_t kAdcBases[] = { 0x40012400, 0x40012800 };
+// GPIOA, GPIOB, GPIOC
+const uint32_t kGpioBases[] = { 0x40010800, 0x40010c00, 0x40011000 };
+const uint8_t kNumPorts = 3;
+const uint32_t kDma1 = 0x40020000;
+const uint32_t kRcc = 0x40021000;
+const uint32_t kFlashInterface = 0x40022000;
+
+const uint32_t kDwtCtrl = 0xe0001000;
+const uint32_t kDwtCyccnt = 0xe0001004;
+const uint32_t kSysTickCtrl = 0xe000e010;
+const uint32_t kSysTickLoad = 0xe000e014;
+const uint32_t kSysTickVal = 0xe000e018;
+const uint32_t kNvicIser = 0xe000e100;
+const uint32_t kNvicIcer = 0xe000e180;
+const uint32_t kNvicIspr = 0xe000e200;
+const uint32_t kNvicIcpr = 0xe000e280;
+const uint32_t kNvicIabr = 0xe000e300;
+const uint32_t kNvicIpr = 0xe000e400;
+const uint32_t kScbCpuid = 0xe000ed00;
+const uint32_t kScbIcsr = 0xe000ed04;
+const uint32_t kScbVtor = 0xe000ed08;
+const uint32_t kScbAircr = 0xe000ed0c;
+const uint32_t kScbShpr = 0xe000ed18;
+
+// register offsets
+enum TimerRegister {
+  TIM_CR1 = 0x00,
+  TIM_DIER = 0x0c,
+  TIM_SR = 0x10,
+  TIM_EGR = 0x14,
+  TIM_CNT = 0x24,
+  TIM_PSC = 0x28,
+  TIM_ARR = 0x2c,
+  TIM_CCR1 = 0x34
+};
+
+enum AdcRegister {
+  ADC_SR = 0x00,
+  ADC_CR1 = 0x04,
+  ADC_CR2 = 0x08,
+  ADC_SMPR1 = 0x0c,
+  ADC_SMPR2 = 0x10,
+  ADC_SQR1 = 0x2c,
+  ADC_SQR2 = 0x30,
+  ADC_SQR3 = 0x34,
+  ADC_DR = 0x4c
+};
+
+enum GpioRegister {
+  GPIO_CRL = 0x00,
+  GPIO_CRH = 0x04,
+  GPIO_IDR = 0x08,
+  GPIO_ODR = 0x0c,
+  GPIO_BSRR = 0x10,
+  GPIO_BRR = 0x14
+};
+
+// one run of an exception handler, without the handlers preempting it
+struct Invocation {
+  uint64_t start;
+  uint32_t instructions;
+  // of which 32-bit Thumb-2 encodings
+  uint32_t wide;
+  uint32_t cycles;
+};
+
+class Stm32Emulator {
+ public:
+  Stm32Emulator() : uc_(NULL), image_base_(kFlashBase) { }
+  ~Stm32Emulator() {
+    for (size_t i=0; i<contexts_.size(); i++)
+      uc_context_free(contexts_[i]);
+    if (uc_)
+      uc_close(uc_);
+  }
+
+  bool Init() {
+    flash_.assign(kFlashSize, 0xff);
+    ram_.assign(kRamSize, 0);
+    system_memory_.assign(kSystemMemorySize, 0);
+    // flash size in KB, read by some startup code
+    system_memory_[0x7e0] = (kFlashSize >> 10) & 0xff;
+    system_memory_[0x7e1] = kFlashSize >> 18;
+    peripherals_.assign(kPeripheralSize / 4, 0);
+    ppb_.assign(kPpbSize / 4, 0);
+    kinds_.assign(kFlashSize / 2, 0);
+    for (int i=0; i<EXCEPTION_LAST; i++) {
+      enabled_[i] = pending_[i] = active_[i] = false;
+      invocations_[i].clear();
+    }
+    for (uint8_t i=0; i<18; i++)
+      for (uint8_t j=0; j<8; j++)
+	analog_[i][j] = 2048;
+    for (uint8_t i=0; i<kNumPorts; i++) {
+      pin_mask_[i] = pin_level_[i] = 0;
+      peripheral(kGpioBases[i] + GPIO_CRL) = 0x44444444;
+      peripheral(kGpioBases[i] + GPIO_CRH) = 0x44444444;
+    }
+    for (uint8_t i=0; i<kNumTimers; i++) {
+      timers_[i].running = false;
+      peripheral(kTimerBases[i] + TIM_ARR) = 0xffff;
+      for (uint8_t j=0; j<4; j++)
+	compare_writes_[i][j] = 0;
+    }
+    for (uint8_t i=0; i<2; i++)
+      converters_[i].converting = false;
+    peripheral(kRcc) = 0x83;
+    ppb(kScbCpuid) = 0x411fc231;
+    cycles_ = idle_cycles_ = 0;
+    prigroup_ = 0;
+    dma_index_ = dma_count_ = 0;
+    systick_next_ = 0;
+    cyccnt_origin_ = 0;
+    waiting_ = stopped_ = false;
+    it_remaining_ = 0;
+    next_address_ = 0;
+    error_.clear();
+
+    uc_err err = uc_open(UC_ARCH_ARM,
+			 static_cast<uc_mode>(UC_MODE_THUMB | UC_MODE_MCLASS),
+			 &uc_);
+    if (!err)
+      err = uc_ctl_set_cpu_model(uc_, UC_CPU_ARM_CORTEX_M3);
+    // the boot alias at 0 and the flash share their memory
+    if (!err)
+      err = uc_mem_map_ptr(uc_, 0, kFlashSize, UC_PROT_ALL, &flash_[0]);
+    if (!err)
+      err = uc_mem_map_ptr(uc_, kFlashBase, kFlashSize, UC_PROT_ALL,
+			   &flash_[0]);
+    if (!err)
+      err = uc_mem_map_ptr(uc_, kRamBase, kRamSize, UC_PROT_ALL, &ram_[0]);
+    if (!err)
+      err = uc_mem_map_ptr(uc_, kSystemMemoryBase, kSystemMemorySize,
+			   UC_PROT_ALL, &system_memory_[0]);
+    if (!err)
+      err = uc_mmio_map(uc_, kPeripheralBase, kPeripheralSize,
+			&OnPeripheralRead, this, &OnPeripheralWrite, this);
+    if (!err)
+      err = uc_mmio_map(uc_, kPeripheralBase + kBitBandOffset,
+			kPeripheralSize * 32,
+			&OnBitBandRead<kPeripheralBase>, this,
+			&OnBitBandWrite<kPeripheralBase>, this);
+    if (!err)
+      err = uc_mmio_map(uc_, kRamBase + kBitBandOffset, kRamSize * 32,
+			&OnBitBandRead<kRamBase>, this,
+			&OnBitBandWrite<kRamBase>, this);
+    if (!err)
+      err = uc_mmio_map(uc_, kPpbBase, kPpbSize,
+			&OnPpbRead, this, &OnPpbWrite, this);
+    uc_hook hook;
+    if (!err)
+      err = uc_hook_add(uc_, &hook, UC_HOOK_CODE,
+			reinterpret_cast<void*>(&OnCode), this, 1, 0);
+    if (!err)
+      err = uc_hook_add(uc_, &hook, UC_HOOK_MEM_READ,
+			reinterpret_cast<void*>(&OnFlashRead), this,
+			0, kFlashSize - 1);
+    if (!err)
+      err = uc_hook_add(uc_, &hook, UC_HOOK_MEM_READ,
+			reinterpret_cast<void*>(&OnFlashRead), this,
+			kFlashBase, kFlashBase + kFlashSize - 1);
+    if (err) {
+      Fail("unicorn: %s", uc_strerror(err));
+      return false;
+    }
+    return true;
+  }
+
+  // the loadable segments at their load addresses, and the symbols of the
+  // functions; the vector table is at the lowest address in flash
+  bool LoadElf(const char* path) {
+    std::vector<uint8_t> file;
+    if (!ReadFile(path, &file))
+      return false;
+    if (file.size() < sizeof(Elf32_Ehdr) ||
+	memcmp(&file[0], ELFMAG, SELFMAG) ||
+	file[EI_CLASS] != ELFCLASS32) {
+      Fail("%s: not a 32-bit ELF file", path);
+      return false;
+    }
+    const Elf32_Ehdr* header = reinterpret_cast<const Elf32_Ehdr*>(&file[0]);
+    if (header->e_machine != EM_ARM) {
+      Fail("%s: not an ARM executable", path);
+      return false;
+    }
+
+    image_base_ = kFlashBase + kFlashSize;
+    for (uint16_t i=0; i<header->e_phnum; i++) {
+      const Elf32_Phdr* segment = reinterpret_cast<const Elf32_Phdr*>(
+	  &file[header->e_phoff + i * header->e_phentsize]);
+      if (segment->p_type != PT_LOAD || !segment->p_filesz)
+	continue;
+      if (!Store(segment->p_paddr, &file[segment->p_offset],
+		 segment->p_filesz)) {
+	Fail("%s: segment at 0x%08x outside of the memory", path,
+	     segment->p_paddr);
+	return false;
+      }
+      if (segment->p_paddr >= kFlashBase)
+	image_base_ = std::min(image_base_, segment->p_paddr);
+    }
+
+    for (uint16_t i=0; i<header->e_shnum; i++) {
+      const Elf32_Shdr* section = reinterpret_cast<const Elf32_Shdr*>(
+	  &file[header->e_shoff + i * header->e_shentsize]);
+      if (section->sh_type != SHT_SYMTAB)
+	continue;
+      const Elf32_Shdr* strings = reinterpret_cast<const Elf32_Shdr*>(
+	  &file[header->e_shoff + section->sh_link * header->e_shentsize]);
+      for (uint32_t j=0; j<section->sh_size / sizeof(Elf32_Sym); j++) {
+	const Elf32_Sym* symbol = reinterpret_cast<const Elf32_Sym*>(
+	    &file[section->sh_offset + j * sizeof(Elf32_Sym)]);
+	if (ELF32_ST_TYPE(symbol->st_info) == STT_FUNC && symbol->st_name)
+	  symbols_[symbol->st_value & ~1] = reinterpret_cast<const char*>(
+	      &file[strings->sh_offset + symbol->st_name]);
+      }
+    }
+    return true;
+  }
+
+  // a raw image, with its vector table at its start
+  bool LoadBinary(const char* path, uint32_t address) {
+    std::vector<uint8_t> file;
+    if (!ReadFile(path, &file))
+      return false;
+    if (!Store(address, &file[0], file.size())) {
+      Fail("%s: %d bytes do not fit at 0x%08x", path,
+	   static_cast<int>(file.size()), address);
+      return false;
+    }
+    image_base_ = address;
+    return true;
+  }
+
+  // starts the image as the bootloader would: from its vector table
+  void Reset() {
+    ppb(kScbVtor) = image_base_;
+    WriteRegister(UC_ARM_REG_SP, Word(image_base_));
+    WriteRegister(UC_ARM_REG_PC, Word(image_base_ + 4) | 1);
+    Frame thread = { 0, 256, cycles_, 0, 0, 0 };
+    frames_.assign(1, thread);
+  }
+
+  // emulates up to a cycle from the reset, past it if a handler is
+  // running then; false on error
+  bool RunUntil(uint64_t end) {
+    end_ = end;
+    Execute(false);
+    return error_.empty();
+  }
+
+  // 12-bit value converted on an ADC channel (0-17) for a mux address
+  inline void set_analog(uint8_t channel, uint8_t mux, uint16_t value) {
+    analog_[channel][mux] = value;
+  }
+
+  // level of an input pin of GPIOA-C (0-2), instead of its pull
+  inline void set_pin(uint8_t port, uint8_t pin, bool level) {
+    pin_mask_[port] |= 1 << pin;
+    pin_level_[port] = (pin_level_[port] & ~(1 << pin)) | (level << pin);
+  }
+
+  // compare register of TIM1-4 (0-3), channel 1-4 (0-3)
+  inline uint32_t compare(uint8_t timer, uint8_t channel) {
+    return peripheral(kTimerBases[timer] + TIM_CCR1 + 4 * channel);
+  }
+  inline uint32_t compare_writes(uint8_t timer, uint8_t channel) const {
+    return compare_writes_[timer][channel];
+  }
+  // in timer cycles
+  inline uint32_t period(uint8_t timer) {
+    return peripheral(kTimerBases[timer] + TIM_ARR) + 1;
+  }
+
+  inline uint64_t cycles() const { return cycles_; }
+  // spent in WFI
+  inline uint64_t idle_cycles() const { return idle_cycles_; }
+  inline const char* error() const { return error_.c_str(); }
+
+  inline const std::vector<Invocation>& invocations(int exception) const {
+    return invocations_[exception];
+  }
+
+  // the handler's symbol, or the exception as the reference manual names it
+  std::string Name(int exception) {
+    std::map<uint32_t, std::string>::const_iterator symbol =
+      symbols_.find(Handler(exception) & ~1);
+    if (symbol != symbols_.end())
+      return symbol->second;
+    switch (exception) {
+    case EXCEPTION_SYSTICK: return "SysTick";
+    case EXCEPTION_DMA1_CHANNEL1: return "DMA1_Channel1 (IRQ 11)";
+    case EXCEPTION_ADC1_2: return "ADC1_2 (IRQ 18)";
+    case EXCEPTION_TIM1_UP: return "TIM1_UP (IRQ 25)";
+    case EXCEPTION_TIM2: return "TIM2 (IRQ 28)";
+    case EXCEPTION_TIM3: return "TIM3 (IRQ 29)";
+    case EXCEPTION_TIM4: return "TIM4 (IRQ 30)";
+    }
+    char name[32];
+    if (exception >= 16)
+      snprintf(name, sizeof(name), "IRQ %d", exception - 16);
+    else
+      snprintf(name, sizeof(name), "exception %d", exception);
+    return name;
+  }
+
+ private:
+  struct Frame {
+    int exception;
+    int priority;
+    uint64_t start;
+    uint32_t instructions;
+    uint32_t wide;
+    uint32_t cycles;
+  };
+
+  struct Timer {
+    bool running;
+    uint64_t next_update;
+    // of the current period, in CPU cycles
+    uint64_t length;
+  };
+
+  struct Converter {
+    bool converting;
+    uint8_t rank;
+    uint8_t count;
+    uint8_t mux;
+    uint64_t next_end;
+  };
+
+  // cycles and side effects of an instruction, cached per flash halfword
+  enum Kind {
+    KIND_CYCLES = 0x1f,
+    // the instruction may unmask a pending interrupt
+    KIND_MASK = 0x20,
+    KIND_IT = 0x40,
+    KIND_DIVIDE = 0x80
+  };
+
+  void Fail(const char* format, ...) __attribute__((format(printf, 2, 3))) {
+    char message[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    error_ = message;
+  }
+
+  bool ReadFile(const char* path, std::vector<uint8_t>* data) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+      Fail("%s: cannot open", path);
+      return false;
+    }
+    uint8_t buffer[4096];
+    size_t size;
+    while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0)
+      data->insert(data->end(), buffer, buffer + size);
+    fclose(file);
+    if (data->empty()) {
+      Fail("%s: empty", path);
+      return false;
+    }
+    return true;
+  }
+
+  // host memory behind an address of flash, RAM or system memory
+  uint8_t* Memory(uint32_t address, uint32_t size) {
+    if (address + size <= kFlashSize)
+      return &flash_[address];
+    if (address >= kFlashBase && address + size <= kFlashBase + kFlashSize)
+      return &flash_[address - kFlashBase];
+    if (address >= kRamBase && address + size <= kRamBase + kRamSize)
+      return &ram_[address - kRamBase];
+    if (address >= kSystemMemoryBase &&
+	address + size <= kSystemMemoryBase + kSystemMemorySize)
+      return &system_memory_[address - kSystemMemoryBase];
+    return NULL;
+  }
+
+  bool Store(uint32_t address, const uint8_t* data, uint32_t size) {
+    uint8_t* memory = Memory(address, size);
+    if (!memory)
+      return false;
+    memcpy(memory, data, size);
+    return true;
+  }
+
+  uint32_t Word(uint32_t address) {
+    uint8_t* memory = Memory(address, 4);
+    uint32_t word = 0;
+    if (memory)
+      memcpy(&word, memory, 4);
+    return word;
+  }
+
+  inline uint16_t Halfword(uint32_t address) {
+    uint8_t* memory = Memory(address, 2);
+    return memory ? memory[0] | memory[1] << 8 : 0;
+  }
+
+  inline uint32_t ReadRegister(int id) {
+    uint32_t value = 0;
+    uc_reg_read(uc_, id, &value);
+    return value;
+  }
+
+  inline void WriteRegister(int id, uint32_t value) {
+    uc_reg_write(uc_, id, &value);
+  }
+
+  inline uint32_t& peripheral(uint32_t address) {
+    return peripherals_[(address - kPeripheralBase) >> 2];
+  }
+
+  inline uint32_t& ppb(uint32_t address) {
+    return ppb_[(address - kPpbBase) >> 2];
+  }
+
+  inline uint32_t Handler(int exception) {
+    return Word(ppb(kScbVtor) + 4 * exception);
+  }
+
+  // of the configured priority, as the preemption compares it
+  int GroupPriority(int exception) {
+    // reset, NMI and HardFault are fixed above the others
+    if (exception < 4)
+      return exception - 4;
+    uint32_t address = exception >= 16 ?
+      kNvicIpr + exception - 16 : kScbShpr + exception - 4;
+    uint8_t priority = ppb(address & ~3) >> ((address & 3) * 8);
+    return priority >> (prigroup_ + 1);
+  }
+
+  // Execution
+
+  // runs the current context until the handler returns or, in thread
+  // mode, until the end of the run, taking the interrupts on the way
+  void Execute(bool handler) {
+    while (error_.empty()) {
+      uint32_t pc = ReadRegister(UC_ARM_REG_PC);
+      if (handler && pc == kReturnAddress)
+	return;
+      Update();
+      int exception = PendingException();
+      if (exception) {
+	Enter(exception);
+	continue;
+      }
+      if (waiting_) {
+	// a masked interrupt wakes the core without being taken
+	bool wake = false;
+	for (int i=2; i<EXCEPTION_LAST; i++)
+	  wake = wake || (pending_[i] && (i < 16 || enabled_[i]));
+	if (wake) {
+	  waiting_ = false;
+	  continue;
+	}
+	uint64_t next = NextEvent();
+	if (!handler) {
+	  if (cycles_ >= end_)
+	    return;
+	  next = std::min(next, end_);
+	} else if (next == UINT64_MAX) {
+	  Fail("WFI in %s with nothing left to wake it",
+	       Name(frames_.back().exception).c_str());
+	  return;
+	}
+	if (next > cycles_) {
+	  idle_cycles_ += next - cycles_;
+	  cycles_ = next;
+	}
+	continue;
+      }
+      if (!handler && cycles_ >= end_)
+	return;
+
+      stop_cycle_ = handler ? NextEvent() : std::min(NextEvent(), end_);
+      stopped_ = false;
+      uc_err err = uc_emu_start(uc_, pc | 1, kReturnAddress, 0, 0);
+      if (err) {
+	Fail("unicorn: %s at 0x%08x", uc_strerror(err),
+	     ReadRegister(UC_ARM_REG_PC));
+	return;
+      }
+      if (waiting_) {
+	WriteRegister(UC_ARM_REG_PC, (stop_address_ + 2) | 1);
+      } else if (stopped_) {
+	// stopped after the instruction rather than before it
+	if (ReadRegister(UC_ARM_REG_PC) != stop_address_)
+	  Account(stop_address_, stop_size_);
+      } else if (ReadRegister(UC_ARM_REG_PC) != kReturnAddress) {
+	Fail("emulation stopped at 0x%08x", ReadRegister(UC_ARM_REG_PC));
+	return;
+      }
+    }
+  }
+
+  int PendingException() {
+    uint32_t primask = ReadRegister(UC_ARM_REG_PRIMASK);
+    if (primask & 1)
+      return 0;
+    int exception = 0;
+    int priority = frames_.back().priority;
+    for (int i=2; i<EXCEPTION_LAST; i++) {
+      if (!pending_[i] || (i >= 16 && !enabled_[i]))
+	continue;
+      int p = GroupPriority(i);
+      if (p < priority) {
+	exception = i;
+	priority = p;
+      }
+    }
+    return exception;
+  }
+
+  // stacks the context and runs the handler as a function returning to
+  // kReturnAddress
+  void Enter(int exception) {
+    size_t depth = frames_.size() - 1;
+    if (contexts_.size() <= depth) {
+      uc_context* context;
+      uc_context_alloc(uc_, &context);
+      contexts_.push_back(context);
+    }
+    uc_context_save(uc_, contexts_[depth]);
+    pending_[exception] = false;
+    active_[exception] = true;
+    waiting_ = false;
+
+    uint32_t sp = (ReadRegister(UC_ARM_REG_SP) - 32) & ~7;
+    WriteRegister(UC_ARM_REG_SP, sp);
+    WriteRegister(UC_ARM_REG_LR, kReturnAddress | 1);
+    WriteRegister(UC_ARM_REG_PC, Handler(exception) | 1);
+    Frame frame = {
+      exception, GroupPriority(exception), cycles_, 0, 0, kEntryCycles
+    };
+    frames_.push_back(frame);
+    cycles_ += kEntryCycles;
+    next_address_ = 0;
+    it_remaining_ = 0;
+
+    Execute(true);
+    if (!error_.empty())
+      return;
+
+    frame = frames_.back();
+    frames_.pop_back();
+    frame.cycles += kExitCycles;
+    cycles_ += kExitCycles;
+    active_[exception] = false;
+    Invocation invocation = {
+      frame.start, frame.instructions, frame.wide, frame.cycles
+    };
+    invocations_[exception].push_back(invocation);
+    uc_context_restore(uc_, contexts_[depth]);
+    next_address_ = 0;
+  }
+
+  static void OnCode(uc_engine* uc, uint64_t address, uint32_t size,
+		     void* user_data) {
+    static_cast<Stm32Emulator*>(user_data)->Step(address, size);
+  }
+
+  inline void Step(uint32_t address, uint32_t size) {
+    // never between an IT and the instructions it conditions
+    if (!it_remaining_ && cycles_ >= stop_cycle_) {
+      Stop(address, size);
+      return;
+    }
+    uint16_t first = Halfword(address);
+    // WFI, WFE
+    if (first == 0xbf30 || first == 0xbf20) {
+      frames_.back().instructions++;
+      frames_.back().cycles++;
+      cycles_++;
+      waiting_ = true;
+      Stop(address, size);
+      return;
+    }
+    Account(address, size);
+  }
+
+  inline void Stop(uint32_t address, uint32_t size) {
+    stopped_ = true;
+    stop_address_ = address;
+    stop_size_ = size;
+    uc_emu_stop(uc_);
+  }
+
+  inline void Account(uint32_t address, uint32_t size) {
+    uint8_t kind = Kind(address, size);
+    uint32_t cycles = kind & KIND_CYCLES;
+    if (kind & KIND_DIVIDE)
+      cycles = DivideCycles(address);
+    if (next_address_ && address != next_address_)
+      cycles += kBranchCycles;
+    next_address_ = address + size;
+    if (it_remaining_)
+      it_remaining_--;
+    if (kind & KIND_IT)
+      it_remaining_ = 4 - __builtin_ctz(Halfword(address) & 0xf);
+    if (kind & KIND_MASK)
+      stop_cycle_ = 0;
+
+    Frame& frame = frames_.back();
+    frame.instructions++;
+    frame.wide += size == 4;
+    frame.cycles += cycles;
+    cycles_ += cycles;
+  }
+
+  uint8_t Kind(uint32_t address, uint32_t size) {
+    uint8_t* cached = NULL;
+    if (address < kFlashSize)
+      cached = &kinds_[address >> 1];
+    else if (address >= kFlashBase && address < kFlashBase + kFlashSize)
+      cached = &kinds_[(address - kFlashBase) >> 1];
+    if (cached && *cached)
+      return *cached;
+    uint8_t kind = Decode(Halfword(address),
+			  size == 4 ? Halfword(address + 2) : 0, size);
+    if (cached)
+      *cached = kind;
+    return kind;
+  }
+
+  static uint8_t Decode(uint16_t first, uint16_t second, uint32_t size) {
+    if (size == 2) {
+      uint8_t op = first >> 12;
+      // load/store register offset, immediate and SP-relative, and
+      // literal loads
+      if (op == 5 || op == 6 || op == 7 || op == 8 || op == 9 ||
+	  (first >> 11) == 9)
+	return 2;
+      // LDM/STM
+      if (op == 0xc)
+	return 1 + __builtin_popcount(first & 0xff);
+      // PUSH/POP
+      if ((first & 0xf600) == 0xb400)
+	return 1 + __builtin_popcount(first & 0x1ff);
+      // IT (not the hints sharing its encoding)
+      if ((first & 0xff00) == 0xbf00 && (first & 0xf))
+	return 1 | KIND_IT;
+      // CPSIE
+      if (first == 0xb662)
+	return 1 | KIND_MASK;
+      return 1;
+    }
+    // LDM/STM, PUSH/POP
+    if ((first & 0xfe40) == 0xe800)
+      return 1 + __builtin_popcount(second & 0xdfff);
+    // TBB/TBH, LDRD/STRD, exclusives
+    if ((first & 0xfe40) == 0xe840) {
+      if ((first & 0xfff0) == 0xe8d0 && (second & 0xffe0) == 0xf000)
+	return 2;
+      return (first & 0xff00) == 0xe800 ? 2 : 3;
+    }
+    // load/store single
+    if ((first & 0xfe00) == 0xf800)
+      return 2;
+    // MUL (no accumulator), MLA, MLS
+    if ((first & 0xfff0) == 0xfb00)
+      return (second >> 12) == 0xf ? 1 : 2;
+    // SDIV, UDIV
+    if ((first & 0xffd0) == 0xfb90)
+      return KIND_DIVIDE;
+    // long multiplies and multiply-accumulates
+    if ((first & 0xff80) == 0xfb80)
+      return 5;
+    // MSR (PRIMASK, BASEPRI, FAULTMASK)
+    if ((first & 0xfff0) == 0xf380 && (second & 0xd000) == 0x8000)
+      return 1 | KIND_MASK;
+    return 1;
+  }
+
+  uint32_t DivideCycles(uint32_t address) {
+    static const int kRegisters[] = {
+      UC_ARM_REG_R0, UC_ARM_REG_R1, UC_ARM_REG_R2, UC_ARM_REG_R3,
+      UC_ARM_REG_R4, UC_ARM_REG_R5, UC_ARM_REG_R6, UC_ARM_REG_R7,
+      UC_ARM_REG_R8, UC_ARM_REG_R9, UC_ARM_REG_R10, UC_ARM_REG_R11,
+      UC_ARM_REG_R12, UC_ARM_REG_SP, UC_ARM_REG_LR, UC_ARM_REG_PC
+    };
+    uint16_t first = Halfword(address);
+    uint16_t second = Halfword(address + 2);
+    uint32_t n = ReadRegister(kRegisters[first & 0xf]);
+    uint32_t d = ReadRegister(kRegisters[second & 0xf]);
+    // SDIV
+    if (!(first & 0x20)) {
+      n = static_cast<int32_t>(n) < 0 ? -n : n;
+      d = static_cast<int32_t>(d) < 0 ? -d : d;
+    }
+    if (!d || n < d)
+      return 2;
+    uint32_t bits = __builtin_clz(d) - __builtin_clz(n) + 1;
+    return std::min(2 + (bits + 2) / 3, 12u);
+  }
+
+  static void OnFlashRead(uc_engine* uc, uc_mem_type type, uint64_t address,
+			  int size, int64_t value, void* user_data) {
+    Stm32Emulator* emulator = static_cast<Stm32Emulator*>(user_data);
+    emulator->frames_.back().cycles += kFlashWaitStates;
+    emulator->cycles_ += kFlashWaitStates;
+  }
+
+  // Events
+
+  // next update, SysTick wrap or end of conversion
+  uint64_t NextEvent() {
+    uint64_t next = UINT64_MAX;
+    for (uint8_t i=0; i<kNumTimers; i++)
+      if (timers_[i].running)
+	next = std::min(next, timers_[i].next_update);
+    if (ppb(kSysTickCtrl) & 1)
+      next = std::min(next, systick_next_);
+    for (uint8_t i=0; i<2; i++)
+      if (converters_[i].converting)
+	next = std::min(next, converters_[i].next_end);
+    return next;
+  }
+
+  // the events up to now, and the interrupt lines they raise
+  void Update() {
+    for (uint8_t i=0; i<kNumTimers; i++) {
+      Timer& timer = timers_[i];
+      while (timer.running && timer.next_update <= cycles_) {
+	peripheral(kTimerBases[i] + TIM_SR) |= 1;
+	timer.length = TimerLength(i);
+	timer.next_update += timer.length;
+      }
+    }
+    while ((ppb(kSysTickCtrl) & 1) && systick_next_ <= cycles_) {
+      ppb(kSysTickCtrl) |= 1 << 16;
+      if (ppb(kSysTickCtrl) & 2)
+	pending_[EXCEPTION_SYSTICK] = true;
+      systick_next_ += SysTickLength();
+    }
+    for (uint8_t i=0; i<2; i++)
+      while (converters_[i].converting && converters_[i].next_end <= cycles_)
+	EndConversion(i);
+
+    // level-sensitive: sampled again when the handler returns
+    uint32_t tim1 = peripheral(kTimerBases[0] + TIM_SR) &
+      peripheral(kTimerBases[0] + TIM_DIER);
+    Line(EXCEPTION_TIM1_UP, tim1 & 1);
+    Line(EXCEPTION_TIM1_CC, tim1 & 0x1e);
+    for (uint8_t i=1; i<kNumTimers; i++)
+      Line(EXCEPTION_TIM2 + i - 1, peripheral(kTimerBases[i] + TIM_SR) &
+	   peripheral(kTimerBases[i] + TIM_DIER) & 0x5f);
+    bool adc = false;
+    for (uint8_t i=0; i<2; i++)
+      adc = adc || ((peripheral(kAdcBases[i] + ADC_SR) & 2) &&
+		    (peripheral(kAdcBases[i] + ADC_CR1) & 0x20));
+    Line(EXCEPTION_ADC1_2, adc);
+    Line(EXCEPTION_DMA1_CHANNEL1,
+	 peripheral(kDma1) & peripheral(kDma1 + 0x08) & 0xe);
+  }
+
+  inline void Line(int exception, bool level) {
+    if (level && !active_[exception])
+      pending_[exception] = true;
+  }
+
+  // Timers
+
+  uint64_t TimerLength(uint8_t i) {
+    uint32_t base = kTimerBases[i];
+    return static_cast<uint64_t>(peripheral(base + TIM_PSC) + 1) *
+      (peripheral(base + TIM_ARR) + 1);
+  }
+
+  void StartTimer(uint8_t i, uint32_t count) {
+    uint32_t base = kTimerBases[i];
+    uint32_t arr = peripheral(base + TIM_ARR);
+    Timer& timer = timers_[i];
+    timer.running = true;
+    timer.length = TimerLength(i);
+    timer.next_update = cycles_ +
+      static_cast<uint64_t>(count <= arr ? arr + 1 - count : 1) *
+      (peripheral(base + TIM_PSC) + 1);
+  }
+
+  uint32_t Counter(uint8_t i) {
+    uint32_t base = kTimerBases[i];
+    const Timer& timer = timers_[i];
+    if (!timer.running)
+      return peripheral(base + TIM_CNT);
+    uint64_t elapsed = cycles_ + timer.length - timer.next_update;
+    return std::min<uint64_t>(elapsed / (peripheral(base + TIM_PSC) + 1),
+			      peripheral(base + TIM_ARR));
+  }
+
+  void WriteTimer(uint8_t i, uint32_t offset, uint32_t value,
+		  uint32_t previous) {
+    uint32_t base = kTimerBases[i];
+    switch (offset) {
+    case TIM_CR1:
+      if ((value & 1) && !timers_[i].running) {
+	StartTimer(i, peripheral(base + TIM_CNT));
+      } else if (!(value & 1) && timers_[i].running) {
+	peripheral(base + TIM_CNT) = Counter(i);
+	timers_[i].running = false;
+      }
+      break;
+    case TIM_SR:
+      // rc_w0
+      peripheral(base + TIM_SR) = previous & value;
+      break;
+    case TIM_EGR:
+      // UG: reload, and the update flag unless URS
+      if (value & 1) {
+	peripheral(base + TIM_CNT) = 0;
+	if (timers_[i].running)
+	  StartTimer(i, 0);
+	if (!(peripheral(base + TIM_CR1) & 4))
+	  peripheral(base + TIM_SR) |= 1;
+      }
+      peripheral(base + TIM_EGR) = 0;
+      break;
+    case TIM_CNT:
+      if (timers_[i].running)
+	StartTimer(i, value & 0xffff);
+      break;
+    }
+  }
+
+  uint64_t SysTickLength() {
+    uint32_t length = (ppb(kSysTickLoad) & 0xffffff) + 1;
+    // CLKSOURCE: the core clock, or HCLK / 8
+    return ppb(kSysTickCtrl) & 4 ? length : 8 * length;
+  }
+
+  // ADC
+
+  uint8_t AdcChannel(uint8_t i, uint8_t rank) {
+    uint32_t base = kAdcBases[i];
+    uint32_t sqr = rank < 6 ? peripheral(base + ADC_SQR3) :
+      rank < 12 ? peripheral(base + ADC_SQR2) : peripheral(base + ADC_SQR1);
+    return (sqr >> (5 * (rank % 6))) & 0x1f;
+  }
+
+  uint64_t ConversionCycles(uint8_t i, uint8_t channel) {
+    // half ADC clock cycles: sampling, then 12.5 of conversion
+    static const uint32_t kSampleTimes[] = {
+      3, 15, 27, 57, 83, 111, 143, 479
+    };
+    static const uint32_t kApbPrescalers[] = { 1, 1, 1, 1, 2, 4, 8, 16 };
+    uint32_t base = kAdcBases[i];
+    uint32_t smpr = channel < 10 ? peripheral(base + ADC_SMPR2) :
+      peripheral(base + ADC_SMPR1);
+    uint32_t sample_time = kSampleTimes[(smpr >> (3 * (channel % 10))) & 7];
+    uint32_t cfgr = peripheral(kRcc + 0x04);
+    uint32_t prescaler = kApbPrescalers[(cfgr >> 11) & 7] *
+      2 * (((cfgr >> 14) & 3) + 1);
+    return (sample_time + 25) * prescaler / 2;
+  }
+
+  void StartConversion(uint8_t i) {
+    uint32_t base = kAdcBases[i];
+    Converter& adc = converters_[i];
+    uint32_t sequence = ((peripheral(base + ADC_SQR1) >> 20) & 0xf) + 1;
+    adc.converting = true;
+    adc.rank = 0;
+    adc.count = peripheral(base + ADC_CR1) & 0x100 ? sequence : 1;
+    adc.mux = (peripheral(kGpioBases[0] + GPIO_ODR) >> 3) & 7;
+    adc.next_end = cycles_ + ConversionCycles(i, AdcChannel(i, 0));
+    peripheral(base + ADC_SR) |= 0x10;
+  }
+
+  inline uint32_t Converted(uint8_t i, uint8_t channel, uint8_t mux) {
+    uint16_t value = channel < 18 ? analog_[channel][mux] & 0xfff : 0;
+    return peripheral(kAdcBases[i] + ADC_CR2) & 0x800 ? value << 4 : value;
+  }
+
+  void EndConversion(uint8_t i) {
+    uint32_t base = kAdcBases[i];
+    Converter& adc = converters_[i];
+    uint32_t data = Converted(i, AdcChannel(i, adc.rank), adc.mux);
+    // regular simultaneous: ADC2's conversion of the same rank in the
+    // upper half-word
+    if (i == 0 && ((peripheral(base + ADC_CR1) >> 16) & 0xf) == 6)
+      data |= Converted(1, AdcChannel(1, adc.rank), adc.mux) << 16;
+    peripheral(base + ADC_DR) = data;
+    peripheral(base + ADC_SR) |= 2;
+    if (i == 0 && (peripheral(base + ADC_CR2) & 0x100)) {
+      // the DMA read clears EOC
+      Transfer(data);
+      peripheral(base + ADC_SR) &= ~2;
+    }
+
+    if (++adc.rank < adc.count) {
+      adc.next_end += ConversionCycles(i, AdcChannel(i, adc.rank));
+    } else if (peripheral(base + ADC_CR2) & 2) {
+      // continuous
+      uint64_t end = adc.next_end;
+      StartConversion(i);
+      adc.next_end += end - cycles_;
+    } else {
+      adc.converting = false;
+    }
+  }
+
+  // DMA1 channel 1, from the ADC1 data register
+  void Transfer(uint32_t data) {
+    uint32_t& ccr = peripheral(kDma1 + 0x08);
+    uint32_t& cndtr = peripheral(kDma1 + 0x0c);
+    if (!(ccr & 1) || !cndtr)
+      return;
+    uint32_t size = 1 << ((ccr >> 10) & 3);
+    uint32_t address = peripheral(kDma1 + 0x14) +
+      (ccr & 0x80 ? dma_index_ * size : 0);
+    uint8_t* memory = Memory(address, size);
+    if (memory)
+      memcpy(memory, &data, size);
+    dma_index_++;
+    cndtr--;
+    if (cndtr == dma_count_ / 2)
+      peripheral(kDma1) |= 5;
+    if (!cndtr) {
+      peripheral(kDma1) |= 3;
+      // circular
+      if (ccr & 0x20) {
+	cndtr = dma_count_;
+	dma_index_ = 0;
+      }
+    }
+  }
+
+  // Memory-mapped registers
+
+  static inline uint32_t Extract(uint32_t word, uint32_t address,
+				 unsigned size) {
+    word >>= (address & 3) * 8;
+    return size >= 4 ? word : word & ((1 << (8 * size)) - 1);
+  }
+
+  static inline uint32_t Merge(uint32_t word, uint32_t address, unsigned size,
+			       uint32_t value) {
+    if (size >= 4)
+      return value;
+    uint32_t shift = (address & 3) * 8;
+    uint32_t mask = ((1 << (8 * size)) - 1) << shift;
+    return (word & ~mask) | ((value << shift) & mask);
+  }
+
+  static uint64_t OnPeripheralRead(uc_engine* uc, uint64_t offset,
+				   unsigned size, void* user_data) {
+    uint32_t address = kPeripheralBase + offset;
+    return Extract(static_cast<Stm32Emulator*>(user_data)->ReadPeripheral(
+	address & ~3), address, size);
+  }
+
+  static void OnPeripheralWrite(uc_engine* uc, uint64_t offset, unsigned size,
+				uint64_t value, void* user_data) {
+    Stm32Emulator* emulator = static_cast<Stm32Emulator*>(user_data);
+    uint32_t address = kPeripheralBase + offset;
+    emulator->WritePeripheral(address & ~3, Merge(
+	emulator->peripheral(address & ~3), address, size, value));
+  }
+
+  static uint64_t OnPpbRead(uc_engine* uc, uint64_t offset, unsigned size,
+			    void* user_data) {
+    uint32_t address = kPpbBase + offset;
+    return Extract(static_cast<Stm32Emulator*>(user_data)->ReadPpb(
+	address & ~3), address, size);
+  }
+
+  static void OnPpbWrite(uc_engine* uc, uint64_t offset, unsigned size,
+			 uint64_t value, void* user_data) {
+    Stm32Emulator* emulator = static_cast<Stm32Emulator*>(user_data);
+    uint32_t address = kPpbBase + offset;
+    emulator->WritePpb(address & ~3, Merge(
+	emulator->ppb(address & ~3), address, size, value));
+  }
+
+  // a bit of the peripherals or of the RAM through its alias, 32 bytes
+  // of alias per byte
+  template<uint32_t base>
+  static uint64_t OnBitBandRead(uc_engine* uc, uint64_t offset, unsigned size,
+				void* user_data) {
+    Stm32Emulator* emulator = static_cast<Stm32Emulator*>(user_data);
+    uint32_t address = (base + (offset >> 5)) & ~3;
+    uint32_t bit = ((offset >> 5) & 3) * 8 + ((offset >> 2) & 7);
+    uint32_t word = base == kPeripheralBase ?
+      emulator->ReadPeripheral(address) : emulator->Word(address);
+    return (word >> bit) & 1;
+  }
+
+  template<uint32_t base>
+  static void OnBitBandWrite(uc_engine* uc, uint64_t offset, unsigned size,
+			     uint64_t value, void* user_data) {
+    Stm32Emulator* emulator = static_cast<Stm32Emulator*>(user_data);
+    uint32_t address = (base + (offset >> 5)) & ~3;
+    uint32_t bit = ((offset >> 5) & 3) * 8 + ((offset >> 2) & 7);
+    if (base == kPeripheralBase) {
+      uint32_t word = emulator->peripheral(address);
+      word = value & 1 ? word | (1 << bit) : word & ~(1 << bit);
+      emulator->WritePeripheral(address, word);
+    } else {
+      uint8_t* memory = emulator->Memory(address, 4);
+      uint32_t word;
+      memcpy(&word, memory, 4);
+      word = value & 1 ? word | (1 << bit) : word & ~(1 << bit);
+      memcpy(memory, &word, 4);
+    }
+  }
+
+  uint32_t ReadPeripheral(uint32_t address) {
+    uint32_t& r = peripheral(address);
+    if (address == kRcc) {
+      // HSIRDY, HSERDY and PLLRDY follow HSION, HSEON and PLLON
+      return r | (r & 0x01010001) << 1;
+    } else if (address == kRcc + 0x04) {
+      // SWS follows SW
+      return (r & ~0xc) | (r & 3) << 2;
+    }
+    for (uint8_t i=0; i<kNumTimers; i++)
+      if (address == kTimerBases[i] + TIM_CNT)
+	return Counter(i);
+    for (uint8_t i=0; i<2; i++) {
+      if (address == kAdcBases[i] + ADC_DR)
+	peripheral(kAdcBases[i] + ADC_SR) &= ~2;
+    }
+    for (uint8_t i=0; i<kNumPorts; i++) {
+      uint32_t base = kGpioBases[i];
+      if (address == base + GPIO_IDR) {
+	uint32_t odr = peripheral(base + GPIO_ODR);
+	uint32_t outputs = 0;
+	for (uint8_t pin=0; pin<16; pin++) {
+	  uint32_t cr = peripheral(base + (pin < 8 ? GPIO_CRL : GPIO_CRH));
+	  if ((cr >> (4 * (pin % 8))) & 3)
+	    outputs |= 1 << pin;
+	}
+	// the unset inputs read as their pull, set by ODR
+	uint32_t inputs = (odr & ~pin_mask_[i]) | (pin_level_[i] & pin_mask_[i]);
+	return (odr & outputs) | (inputs & ~outputs);
+      }
+    }
+    return r;
+  }
+
+  void WritePeripheral(uint32_t address, uint32_t value) {
+    uint32_t& r = peripheral(address);
+    uint32_t previous = r;
+    r = value;
+    for (uint8_t i=0; i<kNumTimers; i++) {
+      uint32_t base = kTimerBases[i];
+      if (address >= base && address < base + 0x400) {
+	uint32_t offset = address - base;
+	// the DAC writes: no reconfiguration
+	if (offset >= TIM_CCR1 && offset < TIM_CCR1 + 16) {
+	  compare_writes_[i][(offset - TIM_CCR1) / 4]++;
+	  return;
+	}
+	WriteTimer(i, offset, value, previous);
+      }
+    }
+    for (uint8_t i=0; i<2; i++) {
+      uint32_t base = kAdcBases[i];
+      if (address == base + ADC_SR) {
+	r = previous & value;
+      } else if (address == base + ADC_CR2) {
+	// calibrations end at once
+	r &= ~0xc;
+	bool start = (value & 0x400000) ||
+	  ((previous & 1) && value == previous);
+	r &= ~0x400000;
+	if ((value & 1) && start) {
+	  StartConversion(i);
+	  // ADC2 follows ADC1 in dual mode
+	  if (i == 0 && ((peripheral(base + ADC_CR1) >> 16) & 0xf) == 6)
+	    StartConversion(1);
+	}
+      }
+    }
+    for (uint8_t i=0; i<kNumPorts; i++) {
+      uint32_t base = kGpioBases[i];
+      if (address == base + GPIO_BSRR) {
+	uint32_t& odr = peripheral(base + GPIO_ODR);
+	odr = (odr & ~(value >> 16)) | (value & 0xffff);
+	r = 0;
+	return;
+      } else if (address == base + GPIO_BRR) {
+	peripheral(base + GPIO_ODR) &= ~value;
+	r = 0;
+	return;
+      } else if (address == base + GPIO_ODR) {
+	return;
+      }
+    }
+    if (address == kDma1 + 0x04) {
+      peripheral(kDma1) &= ~value;
+      r = 0;
+    } else if (address == kDma1 + 0x08 && (value & 1) && !(previous & 1)) {
+      dma_index_ = 0;
+      dma_count_ = peripheral(kDma1 + 0x0c);
+    } else if (address == kFlashInterface + 0x0c) {
+      r = previous & ~value;
+    } else if (address == kFlashInterface + 0x10 && (value & 0x40)) {
+      // page or mass erase
+      if (value & 4) {
+	std::fill(flash_.begin(), flash_.end(), 0xff);
+      } else if (value & 2) {
+	uint8_t* page = Memory(peripheral(kFlashInterface + 0x14) &
+			       ~(kFlashPageSize - 1), kFlashPageSize);
+	if (page)
+	  memset(page, 0xff, kFlashPageSize);
+      }
+      std::fill(kinds_.begin(), kinds_.end(), 0);
+      r &= ~0x40;
+      peripheral(kFlashInterface + 0x0c) |= 0x20;
+    }
+    // the configuration may move the next event or raise a line
+    stop_cycle_ = 0;
+  }
+
+  uint32_t ReadPpb(uint32_t address) {
+    uint32_t& r = ppb(address);
+    if (address == kDwtCyccnt && (ppb(kDwtCtrl) & 1)) {
+      return cycles_ - cyccnt_origin_;
+    } else if (address == kSysTickCtrl) {
+      uint32_t value = r;
+      // COUNTFLAG clears on read
+      r &= ~(1 << 16);
+      return value;
+    } else if (address == kSysTickVal && (ppb(kSysTickCtrl) & 1)) {
+      uint64_t divider = ppb(kSysTickCtrl) & 4 ? 1 : 8;
+      return (systick_next_ - cycles_) / divider;
+    } else if (address == kScbIcsr) {
+      return frames_.back().exception |
+	(pending_[EXCEPTION_SYSTICK] ? 1 << 26 : 0);
+    } else if (address == kScbAircr) {
+      return 0xfa050000 | prigroup_ << 8;
+    } else if (address >= kNvicIser && address < kNvicIpr) {
+      uint32_t word = 0;
+      uint32_t first = 16 + ((address & 0x7f) >> 2) * 32;
+      for (uint32_t i=0; i<32 && first + i < EXCEPTION_LAST; i++) {
+	bool bit = address < kNvicIspr ? enabled_[first + i] :
+	  address < kNvicIabr ? pending_[first + i] : active_[first + i];
+	word |= bit << i;
+      }
+      return word;
+    }
+    return r;
+  }
+
+  void WritePpb(uint32_t address, uint32_t value) {
+    uint32_t& r = ppb(address);
+    uint32_t previous = r;
+    r = value;
+    if (address == kDwtCyccnt) {
+      cyccnt_origin_ = cycles_ - value;
+    } else if (address == kDwtCtrl && (value & 1) && !(previous & 1)) {
+      cyccnt_origin_ = cycles_ - ppb(kDwtCyccnt);
+    } else if (address == kSysTickCtrl) {
+      if ((value & 1) && !(previous & 1))
+	systick_next_ = cycles_ + (ppb(kSysTickVal) ?
+	  ppb(kSysTickVal) * (value & 4 ? 1 : 8) : SysTickLength());
+    } else if (address == kSysTickVal) {
+      // any write clears the counter
+      r = 0;
+      ppb(kSysTickCtrl) &= ~(1 << 16);
+      systick_next_ = cycles_ + SysTickLength();
+    } else if (address >= kNvicIser && address < kNvicIabr) {
+      uint32_t first = 16 + ((address & 0x7f) >> 2) * 32;
+      for (uint32_t i=0; i<32 && first + i < EXCEPTION_LAST; i++) {
+	if (!(value & (1 << i)))
+	  continue;
+	if (address < kNvicIcer)
+	  enabled_[first + i] = true;
+	else if (address < kNvicIspr)
+	  enabled_[first + i] = false;
+	else if (address < kNvicIcpr)
+	  pending_[first + i] = true;
+	else
+	  pending_[first + i] = false;
+      }
+      r = 0;
+    } else if (address == kScbIcsr) {
+      if (value & (1 << 26))
+	pending_[EXCEPTION_SYSTICK] = true;
+      if (value & (1 << 25))
+	pending_[EXCEPTION_SYSTICK] = false;
+      if (value & (1 << 28))
+	pending_[14] = true;
+      if (value & (1 << 27))
+	pending_[14] = false;
+      r = 0;
+    } else if (address == kScbVtor) {
+      r = value & 0x3fffff80;
+    } else if (address == kScbAircr) {
+      if ((value >> 16) == 0x05fa) {
+	prigroup_ = (value >> 8) & 7;
+	if (value & 4)
+	  Fail("system reset requested at 0x%08x",
+	       ReadRegister(UC_ARM_REG_PC));
+      }
+      if (!error_.empty())
+	uc_emu_stop(uc_);
+    }
+    stop_cycle_ = 0;
+  }
+
+  uc_engine* uc_;
+  std::vector<uc_context*> contexts_;
+  std::string error_;
+
+  std::vector<uint8_t> flash_;
+  std::vector<uint8_t> ram_;
+  std::vector<uint8_t> system_memory_;
+  std::vector<uint32_t> peripherals_;
+  std::vector<uint32_t> ppb_;
+  std::vector<uint8_t> kinds_;
+  uint32_t image_base_;
+  std::map<uint32_t, std::string> symbols_;
+
+  uint64_t cycles_;
+  uint64_t idle_cycles_;
+  uint64_t end_;
+  uint64_t stop_cycle_;
+  bool stopped_;
+  uint32_t stop_address_;
+  uint32_t stop_size_;
+  bool waiting_;
+  uint8_t it_remaining_;
+  uint32_t next_address_;
+
+  std::vector<Frame> frames_;
+  bool enabled_[EXCEPTION_LAST];
+  bool pending_[EXCEPTION_LAST];
+  bool active_[EXCEPTION_LAST];
+  uint8_t prigroup_;
+  std::vector<Invocation> invocations_[EXCEPTION_LAST];
+
+  Timer timers_[kNumTimers];
+  uint32_t compare_writes_[kNumTimers][4];
+  uint64_t systick_next_;
+  uint64_t cyccnt_origin_;
+  Converter converters_[2];
+  uint16_t analog_[18][8];
+  uint16_t pin_mask_[kNumPorts];
+  uint16_t pin_level_[kNumPorts];
+  uint32_t dma_index_;
+  uint32_t dma_count_;
+};
+
+struct ScenarioInput {
+  const char* name;
+  bool analog;
+  // ADC channel or GPIO port
+  uint8_t source;
+  // mux address or pin
+  uint8_t index;
+};
+
+const ScenarioInput kScenarioInputs[] = {
+  { "cv1", true, 1, 0 },
+  { "cv2", true, 1, 1 },
+  { "cv3", true, 1, 2 },
+  { "cv4", true, 1, 3 },
+  { "reset1", true, 1, 4 },
+  { "reset2", true, 1, 5 },
+  { "reset3", true, 1, 6 },
+  { "reset4", true, 1, 7 },
+  { "pot1", true, 0, 0 },
+  { "pot2", true, 0, 1 },
+  { "pot3", true, 0, 2 },
+  { "pot4", true, 0, 3 },
+  { "tact", true, 0, 4 },
+  { "pb4", false, 1, 4 },
+  { "pb5", false, 1, 5 },
+  { "pa8", false, 0, 8 },
+};
+const uint8_t kNumScenarioInputs = 16;
+
+// Timed changes of the board inputs, one per line: the time (ms), the
+// input and its value, then optionally a period (ms) and a count to
+// repeat the change; ten 2ms triggers on the first reset input:
+//   500 reset1 4095 100 10
+//   502 reset1 2048 100 10
+// The analog inputs are cv1-4 and reset1-4 (ADC channel 1, mux 0-7),
+// pot1-4 and tact (ADC channel 0, mux 0-4), in 12-bit codes, and the
+// switches pb4, pb5 and pa8 are 0 or 1; "<time> end" sets the duration.
+// The inputs start at rest: the analog ones at mid-scale, the tact
+// switch released and the switches at their pull-ups.
+class Scenario {
+ public:
+  Scenario() : duration_(0.0), next_(0) { }
+
+  bool Parse(const char* text) {
+    changes_.clear();
+    Add(0.0, "tact", 4095);
+    Add(0.0, "pb4", 1);
+    Add(0.0, "pb5", 1);
+    Add(0.0, "pa8", 1);
+    duration_ = 0.0;
+    next_ = 0;
+
+    uint32_t number = 0;
+    while (*text) {
+      const char* end = strchr(text, '\n');
+      std::string line(text, end ? end - text : strlen(text));
+      text = end ? end + 1 : text + line.size();
+      ++number;
+      if (line.empty() || line[0] == '#')
+	continue;
+
+      double time, period = 0.0;
+      char name[16];
+      int value = 0, count = 1;
+      int fields = sscanf(line.c_str(), "%lf %15s %d %lf %d", &time, name,
+			  &value, &period, &count);
+      if (fields == 2 && !strcmp(name, "end")) {
+	duration_ = time;
+	continue;
+      }
+      if ((fields != 3 && fields != 5) || Find(name) < 0) {
+	fprintf(stderr, "scenario, line %d: cannot parse \"%s\"\n", number,
+		line.c_str());
+	return false;
+      }
+      for (int i=0; i<count; i++)
+	Add(time + i * period, name, value);
+    }
+    std::stable_sort(changes_.begin(), changes_.end());
+    if (duration_ == 0.0 && !changes_.empty())
+      duration_ = changes_.back().time + 100.0;
+    return true;
+  }
+
+  bool Load(const char* path) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+      fprintf(stderr, "cannot read %s\n", path);
+      return false;
+    }
+    std::string text;
+    char buffer[4096];
+    size_t size;
+    while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0)
+      text.append(buffer, size);
+    fclose(file);
+    return Parse(text.c_str());
+  }
+
+  // the changes up to a time (ms)
+  void Apply(double time, Stm32Emulator* emulator) {
+    for (; next_ < changes_.size() && changes_[next_].time <= time; next_++) {
+      const Change& change = changes_[next_];
+      const ScenarioInput& input = kScenarioInputs[change.input];
+      if (input.analog)
+	emulator->set_analog(input.source, input.index, change.value);
+      else
+	emulator->set_pin(input.source, input.index, change.value);
+    }
+  }
+
+  // ms
+  inline double duration() const { return duration_; }
+
+ private:
+  struct Change {
+    double time;
+    uint8_t input;
+    int value;
+    bool operator<(const Change& other) const { return time < other.time; }
+  };
+
+  static int Find(const char* name) {
+    for (uint8_t i=0; i<kNumScenarioInputs; i++)
+      if (!strcmp(kScenarioInputs[i].name, name))
+	return i;
+    return -1;
+  }
+
+  void Add(double time, const char* name, int value) {
+    Change change = { time, static_cast<uint8_t>(Find(name)), value };
+    changes_.push_back(change);
+  }
+
+  std::vector<Change> changes_;
+  double duration_;
+  size_t next_;
+};
+
+}  // namespace batumi
+
+#endif  // BATUMI_TOOLS_STM32_EMULATOR_H_
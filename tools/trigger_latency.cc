@@ -0,0 +1,186 @@
+// Copyright 2015 Matthias Puech
+//
+// Author: Matthias Puech (matthias.puech@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Latency and jitter of the reset inputs, measured on the host through
+// the whole tick: ADC mux cadence, event queue and processor. Each trial
+// sends one edge at a random time between two ticks to one of two
+// processors run in lockstep; the response is the first tick where their
+// outputs differ, written to the DAC on the next tick.
+
+#include <cstdio>
+
+#include "processor.h"
+#include "tools/harness.h"
+
+using namespace batumi;
+
+// inputs at rest and on the gate, and the threshold the edge time is
+// taken at
+const int16_t kResetLow = 0;
+const int16_t kResetHigh = 30000;
+const int16_t kResetThreshold = 20000;
+// ticks before the edges, for the CV filters and the mode to settle
+const uint32_t kWarmUp = 256;
+// ticks without response after which the edge counts as missed
+const uint32_t kTimeOut = 256;
+// coarse pot of the channels: about 15Hz in the LFO range, so that
+// the outputs move on every tick
+const uint16_t kCoarse = 50000;
+
+struct Control {
+  const char* name;
+  FeatureMode feat_mode;
+  bool sync_mode;
+  uint8_t channel;
+};
+
+const Control kControls[] = {
+  { "FREE reset", FEAT_MODE_FREE, false, 0 },
+  { "FREE sync", FEAT_MODE_FREE, true, 0 },
+  { "QUAD hold", FEAT_MODE_QUAD, false, 1 },
+  { "QUAD direction", FEAT_MODE_QUAD, false, 2 },
+  { "QUAD waveform", FEAT_MODE_QUAD, false, 3 },
+};
+const uint8_t kNumControls = sizeof(kControls) / sizeof(Control);
+
+Processor processors[2];
+
+// Gate on a reset input: a linear rise through the threshold at a given
+// time, the gate length at the high level, then back to rest
+class Gate {
+ public:
+  Gate(double time, double rise, double length)
+      : time_(time), rise_(rise), length_(length) { }
+
+  int16_t value(double t) const {
+    if (t >= time_ + length_)
+      return kResetLow;
+    double v = kResetThreshold +
+      (t - time_) * (kResetHigh - kResetLow) / rise_;
+    CONSTRAIN(v, kResetLow, kResetHigh);
+    return v;
+  }
+
+ private:
+  double time_, rise_, length_;
+};
+
+// Ticks from the edge to the DAC write of the first changed output, or
+// a negative value when the outputs never differ
+double Trial(const Control& control, bool mux, double edge, double clock,
+	     double rise, double length) {
+  ProcessorParameters parameters = { };
+  parameters.feat_mode = control.feat_mode;
+  parameters.range = RANGE_LFO;
+  parameters.cv_mode = CV_MODE_PITCH;
+  parameters.sync_mode = control.sync_mode;
+  for (uint8_t i=0; i<kNumChannels; i++)
+    parameters.coarse[i] = kCoarse;
+
+  // from the state at power-up, the processor being in .bss
+  Mux muxes[2];
+  memset(static_cast<void*>(processors), 0, sizeof(processors));
+  for (uint8_t p=0; p<2; p++)
+    processors[p].Init(SAMPLE_RATE);
+
+  Gate trigger(edge, rise, length);
+  uint32_t end = static_cast<uint32_t>(edge) + kTimeOut;
+  for (uint32_t n=0; n<end; n++) {
+    ProcessorOutput output[2];
+    for (uint8_t p=0; p<2; p++) {
+      int16_t analog[kNumAdcChannels] = { };
+      for (uint8_t i=0; i<kNumChannels; i++)
+	analog[kNumChannels + i] = kResetLow;
+      // the clock of the sync, on both processors, up to the edge
+      if (clock) {
+	double last = edge - clock * floor(edge / clock);
+	for (double t=last; t<edge; t+=clock) {
+	  Gate tick(t - clock * 0.5, rise, length);
+	  if (tick.value(n))
+	    analog[kNumChannels + control.channel] = tick.value(n);
+	}
+      }
+      if (p == 1 && trigger.value(n))
+	analog[kNumChannels + control.channel] = trigger.value(n);
+
+      ProcessorInput input;
+      if (mux) {
+	muxes[p].Tick(analog, &input);
+      } else {
+	for (uint8_t i=0; i<kNumChannels; i++) {
+	  input.cv[i] = analog[i];
+	  input.reset[i] = analog[kNumChannels + i];
+	}
+	input.cv_updated = (1 << kNumChannels) - 1;
+      }
+      processors[p].Process(parameters, &input, &output[p], 1);
+    }
+    if (memcmp(&output[0], &output[1], sizeof(ProcessorOutput)))
+      return n + 1 - edge;
+  }
+  return -1.0;
+}
+
+int main(int argc, char** argv) {
+  uint32_t trials = Option(argc, argv, "trials", 2000);
+  Random random(Option(argc, argv, "seed", 1));
+  // in ticks
+  double rise = Option(argc, argv, "rise", 0.5);
+  double length = Option(argc, argv, "length", 0.005) * SAMPLE_RATE;
+  double clock = Option(argc, argv, "clock", 0.05) * SAMPLE_RATE;
+  double tick = 1e6 / SAMPLE_RATE;
+
+  printf("Sample rate %dHz, %d trials, rise %.2f ticks, gate %.0f ticks\n",
+	 SAMPLE_RATE, trials, rise, length);
+  printf("Latency from the edge to the DAC write (us)\n");
+  printf("%-15s %-10s %8s %8s %8s %8s %8s %8s %7s\n", "control", "inputs",
+	 "min", "median", "mean", "p99", "max", "jitter", "missed");
+  for (uint8_t c=0; c<kNumControls; c++) {
+    for (int8_t mux=1; mux>=0; mux--) {
+      Statistics latency;
+      uint32_t missed = 0;
+      for (uint32_t t=0; t<trials; t++) {
+	// anywhere in a turn of the mux, between two ticks
+	double edge = kWarmUp + random.Uniform() * 2 * kNumAdcChannels;
+	double l = Trial(kControls[c], mux, edge,
+			 kControls[c].sync_mode ? clock : 0.0, rise, length);
+	if (l < 0.0)
+	  missed++;
+	else
+	  latency.Add(l * tick);
+      }
+      printf("%-15s %-10s", kControls[c].name, mux ? "mux" : "every tick");
+      if (latency.count())
+	printf(" %8.1f %8.1f %8.1f %8.1f %8.1f %8.1f", latency.min(),
+	       latency.Percentile(0.5), latency.mean(),
+	       latency.Percentile(0.99), latency.max(), latency.deviation());
+      else
+	printf(" %53s", "");
+      printf(" %7d\n", missed);
+    }
+  }
+  return 0;
+}
@@ -42,11 +42,15 @@ const int32_t kLongPressDuration = 500;
 const int32_t kVeryLongPressDuration = 2000;
 const int32_t kPotMoveThreshold = 1 << (16 - 10);  // 10 bits
 const uint16_t kCatchupThreshold = 1 << 10;
+// 1V/oct, with 5V on half the ADC range
+const int32_t kDefaultCvScale = 2 * 5 * kOctave;
 
 stmlib::Storage<0x8020000, 4> storage;
+stmlib::Storage<0x801F000, 1> calibration_storage;
 
 void Ui::Init(Adc *adc) {
   mode_ = UI_MODE_SPLASH;
+  press_mode_ = UI_MODE_SPLASH;
   adc_ = adc;
   leds_.Init();
   switches_.Init(adc_);
@@ -57,6 +61,26 @@ void Ui::Init(Adc *adc) {
     for (int i=0; i<4; i++)
       pot_fine_value_[i] = 1 << 15;
   }
+  if (range_ >= RANGE_LAST)
+    range_ = RANGE_LFO;
+  if (cv_mode_ >= CV_MODE_LAST)
+    cv_mode_ = CV_MODE_PITCH;
+
+  if (!calibration_storage.Load(&calibration_data_)) {
+    for (uint8_t i=0; i<kNumChannels; i++) {
+      calibration_data_.cv_scale[i] = kDefaultCvScale;
+      calibration_data_.cv_offset[i] = 0;
+    }
+  }
+
+  // holding SELECT at startup enters calibration
+  for (uint8_t i=0; i<8; i++)
+    switches_.Debounce();
+  if (switches_.pressed(SWITCH_SELECT)) {
+    mode_ = UI_MODE_CALIBRATION_1;
+    for (uint8_t i=0; i<kNumChannels; i++)
+      calibration_cv_[i] = adc_->cv(i) << 4;
+  }
 
   // synchronize pots at startup
   for (uint8_t i=0; i<4; i++) {
@@ -64,6 +88,7 @@ void Ui::Init(Adc *adc) {
     pot_value_[i] = pot_filtered_value_[i] = pot_coarse_value_[i] = adc_value;
     catchup_state_[i] = false;
   }
+  UpdateParameters();
 }
 
 void Ui::Poll() {
@@ -119,6 +144,12 @@ void Ui::Poll() {
     }
   }
   
+  // filter the CV inputs while calibrating, with 4 fractional bits
+  if (mode_ == UI_MODE_CALIBRATION_1 || mode_ == UI_MODE_CALIBRATION_2) {
+    for (uint8_t i=0; i<kNumChannels; i++)
+      calibration_cv_[i] += ((adc_->cv(i) << 4) - calibration_cv_[i]) >> 6;
+  }
+
   // paint the interface
   switch (mode_) {
   case UI_MODE_SPLASH:
@@ -133,26 +164,73 @@ void Ui::Poll() {
 
   case UI_MODE_ZOOM:
     animation_counter_++;
+    // as many LEDs after the mode's glow dimly as the CV mode number
     for (uint8_t i=0; i<kNumLeds; i++)
-      leds_.set(i, false);
+      leds_.set(i, (i + kNumLeds - feat_mode_) % kNumLeds <= cv_mode_ &&
+		(animation_counter_ & 7) == 0);
     leds_.set(feat_mode_, animation_counter_ & 128);
     break;
 
+  case UI_MODE_CALIBRATION_1:
+  case UI_MODE_CALIBRATION_2:
+    animation_counter_++;
+    for (uint8_t i=0; i<kNumLeds; i++)
+      leds_.set(i, animation_counter_ &
+		(mode_ == UI_MODE_CALIBRATION_1 ? 256 : 64));
+    break;
+
   case UI_MODE_NORMAL:
     animation_counter_++;
     bool flash = (animation_counter_ & 64) &&
       (animation_counter_ & 32) &&
       (animation_counter_ & 16);
+    // in the VCO range, the other LEDs glow dimly
+    bool glow = range_ == RANGE_VCO && (animation_counter_ & 7) == 0;
     for (uint8_t i=0; i<kNumLeds; i++) {
       if (catchup_state_[i])
 	leds_.set(i, i==feat_mode_ ? !flash : flash);
       else
-	leds_.set(i, i == feat_mode_);
+	leds_.set(i, i == feat_mode_ || glow);
     }
     break;
   }
 
   leds_.Write();
+
+  UpdateParameters();
+}
+
+void Ui::UpdateParameters() {
+  parameters_.feat_mode = feat_mode();
+  parameters_.range = range();
+  parameters_.cv_mode = cv_mode();
+  parameters_.shape = shape();
+  parameters_.sync_mode = sync_mode();
+  for (uint8_t i=0; i<kNumChannels; i++) {
+    parameters_.coarse[i] = coarse(i);
+    parameters_.fine[i] = fine(i);
+    parameters_.cv_scale[i] = calibration_data_.cv_scale[i];
+    parameters_.cv_offset[i] = calibration_data_.cv_offset[i];
+  }
+}
+
+// The CV inputs were measured at 1V (calibration_low_) and 3V
+// (calibration_cv_); on failure the previous calibration is kept.
+void Ui::Calibrate() {
+  CalibrationData calibration;
+  const int32_t nominal_span = (static_cast<int64_t>(2 * kOctave) << 20) /
+    kDefaultCvScale;
+  for (uint8_t i=0; i<kNumChannels; i++) {
+    int32_t span = calibration_cv_[i] - calibration_low_[i];
+    if (span < nominal_span / 2 || span > nominal_span * 2)
+      return;
+    int32_t scale = (static_cast<int64_t>(2 * kOctave) << 20) / span;
+    calibration.cv_scale[i] = scale;
+    calibration.cv_offset[i] = kOctave -
+      ((static_cast<int64_t>(calibration_low_[i]) * scale) >> 20);
+  }
+  calibration_data_ = calibration;
+  calibration_storage.Save(calibration_data_);
 }
 
 void Ui::FlushEvents() {
@@ -160,6 +238,8 @@ void Ui::FlushEvents() {
 }
 
 void Ui::OnSwitchPressed(const Event& e) {
+  if (e.control_id == SWITCH_SELECT)
+    press_mode_ = mode_;
 }
 
 void Ui::OnSwitchReleased(const Event& e) {
@@ -170,6 +250,17 @@ void Ui::OnSwitchReleased(const Event& e) {
     break;
   case SWITCH_SELECT:
     if (e.data > kVeryLongPressDuration) {
+      // from the zoom, cycles the CV modes; otherwise toggles the VCO
+      // range, leaving the zoom entered on the way
+      if (press_mode_ == UI_MODE_ZOOM) {
+	cv_mode_ = (cv_mode_ + 1) % CV_MODE_LAST;
+	mode_ = UI_MODE_ZOOM;
+	storage.ParsimoniousSave(&feat_mode_, SETTINGS_SIZE, &version_token_);
+      } else if (press_mode_ == UI_MODE_NORMAL) {
+	range_ = range_ == RANGE_VCO ? RANGE_LFO : RANGE_VCO;
+	mode_ = UI_MODE_NORMAL;
+	storage.ParsimoniousSave(&feat_mode_, SETTINGS_SIZE, &version_token_);
+      }
     } else if (e.data > kLongPressDuration) {
       if (mode_ == UI_MODE_NORMAL)
 	mode_ = UI_MODE_ZOOM;
@@ -196,6 +287,17 @@ void Ui::OnSwitchReleased(const Event& e) {
 	  pot_fine_value_[i] = 1 << 15;
 	storage.ParsimoniousSave(&feat_mode_, SETTINGS_SIZE, &version_token_);
 	break;
+
+      case UI_MODE_CALIBRATION_1:
+	for (uint8_t i=0; i<kNumChannels; i++)
+	  calibration_low_[i] = calibration_cv_[i];
+	mode_ = UI_MODE_CALIBRATION_2;
+	break;
+
+      case UI_MODE_CALIBRATION_2:
+	Calibrate();
+	mode_ = UI_MODE_NORMAL;
+	break;
       }
     }
     break;
@@ -205,6 +307,8 @@ void Ui::OnSwitchReleased(const Event& e) {
 void Ui::OnPotChanged(const Event& e) {
   switch (mode_) {
   case UI_MODE_SPLASH:
+  case UI_MODE_CALIBRATION_1:
+  case UI_MODE_CALIBRATION_2:
     break;
   case UI_MODE_ZOOM:
     pot_fine_value_[e.control_id] = e.data;
@@ -37,22 +37,24 @@
 #include "drivers/leds.h"
 #include "drivers/switches.h"
 
+#include "processor.h"
+
 namespace batumi {
 
 const uint8_t kFinePotDivider = 8;
 
-enum FeatureMode {
-  FEAT_MODE_FREE,
-  FEAT_MODE_QUAD,
-  FEAT_MODE_PHASE,
-  FEAT_MODE_DIVIDE,
-  FEAT_MODE_LAST
-};
-
 enum UiMode {
   UI_MODE_SPLASH,
   UI_MODE_NORMAL,
   UI_MODE_ZOOM,
+  UI_MODE_CALIBRATION_1,
+  UI_MODE_CALIBRATION_2,
+};
+
+/* per-unit tuning of the CV inputs, see ProcessorParameters */
+struct CalibrationData {
+  int32_t cv_scale[kNumChannels];
+  int16_t cv_offset[kNumChannels];
 };
 
 class Ui {
@@ -74,6 +76,12 @@ class Ui {
   }
 
   inline FeatureMode feat_mode() const { return feat_mode_; }
+  inline FrequencyRange range() const {
+    return static_cast<FrequencyRange>(range_);
+  }
+  inline CvMode cv_mode() const {
+    return static_cast<CvMode>(cv_mode_);
+  }
   inline UiMode mode() const { return mode_; }
   inline uint8_t shape() const {
     return (switches_.pressed(2) << 1) | switches_.pressed(1);
@@ -82,10 +90,16 @@ class Ui {
     return switches_.pressed(0);
   }
 
+  inline const ProcessorParameters& parameters() const {
+    return parameters_;
+  }
+
  private:
   void OnSwitchPressed(const stmlib::Event& e);
   void OnSwitchReleased(const stmlib::Event& e);
   void OnPotChanged(const stmlib::Event& e);
+  void UpdateParameters();
+  void Calibrate();
 
   uint16_t pot_value_[4];
   uint16_t pot_filtered_value_[4];
@@ -102,19 +116,32 @@ class Ui {
   Switches switches_;
   Adc *adc_;
   UiMode mode_;
+  // when SELECT was last pressed
+  UiMode press_mode_;
 
   FeatureMode feat_mode_;
-  uint8_t padding[3];
+  // in the former padding, zero in the settings saved before
+  uint8_t range_;
+  uint8_t cv_mode_;
+  uint8_t padding[1];
   uint16_t pot_fine_value_[4];
 
   enum SettingsSize {
     SETTINGS_SIZE = sizeof(feat_mode_) +
+    sizeof(range_) +
+    sizeof(cv_mode_) +
     sizeof(pot_fine_value_) +
     sizeof(padding)
   };
 
   uint16_t version_token_;
 
+  CalibrationData calibration_data_;
+  int32_t calibration_cv_[kNumChannels];
+  int32_t calibration_low_[kNumChannels];
+
+  ProcessorParameters parameters_;
+
   DISALLOW_COPY_AND_ASSIGN(Ui);
 };
 